@@ -0,0 +1,710 @@
+#include "Benchmarks.hpp"
+#include "VertexRing.hpp"
+#include "BoxParticles.hpp"
+#include "BoxBattle.hpp"
+#include "World.hpp"
+#include "cjs/cjs.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <ctime>
+#endif
+
+// records a check without stopping, so one run shows every failure
+#define OGJ_CHECK(checks, expression) \
+	(checks).Check((expression), #expression, __LINE__)
+
+namespace {
+
+	using steady_clock = std::chrono::steady_clock;
+
+	double SecondsSince(const steady_clock::time_point start) {
+		return std::chrono::duration<double>(steady_clock::now() - start).count();
+	}
+
+	// cpu time used by every thread in the process so far
+	double ProcessCpuSeconds() {
+#ifdef _WIN32
+		FILETIME creation, exit, kernel, user;
+		GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+		const auto seconds = [](const FILETIME& time) {
+			return ((static_cast<uint64>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1e-7;
+		};
+		return seconds(kernel) + seconds(user);
+#else
+		return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+	}
+
+	double Percentile(vector<double> samples, const double p) {
+		if (samples.empty()) return 0.0;
+		std::sort(samples.begin(), samples.end());
+		return samples[static_cast<size_t>(p * (samples.size() - 1))];
+	}
+
+	struct Checks {
+		size_t total = 0;
+		size_t failed = 0;
+
+		void Check(const bool passed, const char* expression, const size_t line) {
+			total++;
+			if (passed) return;
+			// the first few are enough to go on
+			if (++failed <= 20) printf("  check failed on line %zu: %s\n", line, expression);
+		}
+	};
+
+	// the Gpu VertexStream draws through in the ring test, draws are only read once the gpu gets to them
+	// each draw checks that its verticies still hold what was written before it was submitted
+	struct FakeGpu {
+		using fence_t = uint32;
+
+		struct Command {
+			size_t first = 0;
+			vector<uint32> verticies;	// what the draw should read
+			uint32 fence = 0;			// set for fences, which have no verticies
+		};
+
+		const vector<uint32>* buffer = nullptr;
+		Checks* checks = nullptr;
+		size_t regioncapacity = 0;
+		std::deque<Command> commands;
+		uint32 lastfence = 0;
+		uint32 signaled = 0;	// every fence up to this one has passed
+		size_t submitted = 0;
+		size_t draws = 0;
+		size_t waits = 0;		// times a fence was waited on before the gpu had passed it
+
+		void Draw(const size_t first, const size_t count) {
+			// a draw never spans two regions
+			OGJ_CHECK(*checks, count > 0 && first / regioncapacity == (first + count - 1) / regioncapacity);
+			submitted++;
+			Command command;
+			command.first = first;
+			command.verticies.assign(buffer->begin() + first, buffer->begin() + first + count);
+			commands.push_back(std::move(command));
+		}
+
+		uint32 Fence() {
+			Command command;
+			command.fence = ++lastfence;
+			commands.push_back(std::move(command));
+			return lastfence;
+		}
+
+		void Wait(const uint32 fence) {
+			if (!IsSignaled(fence)) {
+				waits++;
+				RunUntil(fence);
+			}
+			OGJ_CHECK(*checks, IsSignaled(fence));
+		}
+
+		void Delete(const uint32 fence) {
+			OGJ_CHECK(*checks, fence != 0 && fence <= lastfence);
+		}
+
+		bool IsSignaled(const uint32 fence) const {
+			return fence <= signaled;
+		}
+
+		// runs up to count commands
+		void Run(size_t count) {
+			for (; count > 0 && !commands.empty(); count--) {
+				const Command& command = commands.front();
+				if (command.fence != 0) {
+					signaled = command.fence;
+				} else {
+					draws++;
+					const bool intact = std::equal(command.verticies.begin(), command.verticies.end(), buffer->begin() + command.first);
+					OGJ_CHECK(*checks, intact);
+				}
+				commands.pop_front();
+			}
+		}
+
+		void RunUntil(const uint32 fence) {
+			while (!IsSignaled(fence) && !commands.empty()) Run(1);
+		}
+	};
+
+	// writes into the same VertexStream SpriteBatch streams through, with the fake gpu in place of gl
+	// every vertex written gets a new number so a draw can tell if its verticies were overwritten
+	struct StreamWriter {
+		VertexStream<FakeGpu> stream;
+		vector<uint32> buffer;
+		size_t regioncapacity = 0;
+		size_t flushbudget = 0;
+		Checks* checks = nullptr;
+		uint32 nextvalue = 1;
+
+		StreamWriter(const size_t regioncapacity_, const size_t regioncount, const size_t flushbudget_, Checks& checks_)
+			: buffer(regioncapacity_ * regioncount, 0), regioncapacity(regioncapacity_), flushbudget(flushbudget_), checks(&checks_) {
+			stream.gpu.buffer = &buffer;
+			stream.gpu.checks = &checks_;
+			stream.gpu.regioncapacity = regioncapacity;
+			stream.Init(regioncapacity, regioncount);
+		}
+
+		// what SpriteBatch::AllocateVerts does
+		void Write(const size_t count) {
+			const size_t first = stream.Reserve(count, flushbudget);
+			const VertexRing& ring = stream.Ring();
+			// never written while the gpu may still be reading it
+			OGJ_CHECK(*checks, !stream.IsFenced(ring.Region()));
+			OGJ_CHECK(*checks, first + count == ring.PendingFirst() + ring.PendingCount());
+			OGJ_CHECK(*checks, first >= ring.Base() && first + count <= ring.Base() + regioncapacity);
+			// only a single write bigger than the budget goes over it
+			OGJ_CHECK(*checks, ring.PendingCount() <= std::max(flushbudget, count));
+			for (size_t i = 0; i < count; i++) {
+				buffer[first + i] = nextvalue++;
+			}
+		}
+
+		// what SpriteBatch::End does
+		void EndFrame() {
+			const size_t region = stream.Ring().Region();
+			stream.EndFrame();
+			const VertexRing& ring = stream.Ring();
+			OGJ_CHECK(*checks, ring.Region() == (region + 1) % (buffer.size() / regioncapacity));
+			OGJ_CHECK(*checks, ring.PendingCount() == 0 && ring.PendingFirst() == ring.Base());
+			OGJ_CHECK(*checks, stream.IsFenced(region) && !stream.IsFenced(ring.Region()));
+		}
+	};
+
+	// the work_queue cjs started with, kept as the baseline for the queue benchmark
+	// one list behind a mutex, with a pool of spare nodes behind a second one
+	class LockedQueue final : public cjs::iqueue {
+		using work_t = cjs::detail::work;
+		using mutex_guard = std::lock_guard<std::mutex>;
+
+		struct node {
+			node* next;
+			work_t work;
+		};
+
+	public:
+		~LockedQueue() {
+			while (front) {
+				node* n = front;
+				front = n->next;
+				delete n;
+			}
+			while (pool) {
+				node* n = pool;
+				pool = n->next;
+				delete n;
+			}
+		}
+
+		void submit(cjs::ijob* job_object) override {
+			work_t work;
+			work.object = job_object;
+			work.type = work_t::type_object;
+			Push(work);
+		}
+
+		void submit(void(*job_func)(void*), void* value) {
+			work_t work;
+			work.func = job_func;
+			work.func_val = value;
+			work.type = work_t::type_func;
+			Push(work);
+		}
+
+		work_t _get_work(cjs::worker_thread* worker) override {
+			mutex_guard mg0(listlock);
+			if (!front) return work_t();
+			node* n = front;
+			front = n->next;
+			if (!front) back = nullptr;
+			const work_t work = n->work;
+
+			mutex_guard mg1(poollock);
+			n->next = pool;
+			pool = n;
+			return work;
+		}
+
+		void _add_worker(cjs::worker_thread* worker) override { }
+		void _remove_worker(cjs::worker_thread* worker) override { }
+		// the old workers never slept, run them with parking off
+		void _park(cjs::worker_thread* worker, const std::atomic_bool& shouldstop) override { }
+		void _unpark_all() override { }
+
+	private:
+		void Push(const work_t& work) {
+			node* n = nullptr;
+			{
+				mutex_guard mg(poollock);
+				if (pool) {
+					n = pool;
+					pool = n->next;
+				}
+			}
+			if (!n) n = new node();
+			n->work = work;
+			n->next = nullptr;
+
+			mutex_guard mg(listlock);
+			if (back) back->next = n;
+			else front = n;
+			back = n;
+		}
+
+		node* front = nullptr;
+		node* back = nullptr;
+		std::mutex listlock;
+		node* pool = nullptr;
+		std::mutex poollock;
+	};
+
+	void CountJob(void* counter) {
+		static_cast<std::atomic_size_t*>(counter)->fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// millions of jobs a second, from submitting the first job to the last one finishing
+	template<typename Queue, typename... Args>
+	double QueueThroughput(const size_t producers, const size_t consumers, const size_t jobsperproducer, const bool parking, Args... args) {
+		Queue queue(args...);
+		std::unique_ptr<cjs::worker_thread[]> workers(new cjs::worker_thread[consumers]);
+		for (size_t i = 0; i < consumers; i++) {
+			workers[i].set_parking(parking);
+			workers[i].attach_to(&queue);
+		}
+
+		std::atomic_size_t done = 0;
+		std::atomic_bool go = false;
+		vector<std::thread> threads;
+		for (size_t i = 0; i < producers; i++) {
+			threads.emplace_back([&queue, &done, &go, jobsperproducer]() {
+				while (!go) std::this_thread::yield();
+				for (size_t j = 0; j < jobsperproducer; j++) {
+					queue.submit(CountJob, &done);
+				}
+			});
+		}
+
+		const size_t total = producers * jobsperproducer;
+		const steady_clock::time_point start = steady_clock::now();
+		go = true;
+		for (auto& thread : threads) thread.join();
+		while (done.load(std::memory_order_relaxed) < total) std::this_thread::yield();
+		const double seconds = SecondsSince(start);
+
+		for (size_t i = 0; i < consumers; i++) {
+			workers[i].attach_to(nullptr);
+		}
+		return total / seconds / 1000000.0;
+	}
+
+	// submits a fence to a queue with no workers, nothing has to stop so the fence should finish right away
+	// waited on from another thread so a fence that never finishes fails instead of hanging the benchmark
+	template<typename Queue, typename Fence, typename... Args>
+	bool FenceWithoutWorkers(Args... args) {
+		struct Pending {
+			Queue queue;
+			Fence fence;
+			std::atomic_bool finished;
+			Pending(Args... args) : queue(args...), finished(false) { }
+		};
+		// leaked if the fence never finishes, the waiting thread still uses it
+		Pending* pending = new Pending(args...);
+		pending->queue.submit(&pending->fence);
+		std::thread waiter([pending]() {
+			pending->fence.await_and_resume();
+			pending->finished = true;
+		});
+
+		const steady_clock::time_point start = steady_clock::now();
+		while (!pending->finished && SecondsSince(start) < 1.0) std::this_thread::yield();
+		if (!pending->finished) {
+			waiter.detach();
+			return false;
+		}
+		waiter.join();
+		delete pending;
+		return true;
+	}
+
+	// the particle step from before particles were split into arrays, the baseline for the particle benchmark
+	void StepParticleStructs(Timestep ts, vector<Particle>& particles) {
+		constexpr float dragcoef = 0.994f;
+		for (Particle& p : particles) {
+			if (!p.isAlive) continue;
+			bounds camera = GetWorld().camera;
+
+			p.position += p.velocity * ts;
+			p.velocity *= dragcoef;
+			p.lifetime += ts;
+
+			if (p.position.x < camera.left)
+				p.position.x += camera.Width();
+			else if (p.position.x > camera.right)
+				p.position.x -= camera.Width();
+
+			if (p.position.y < camera.bottom)
+				p.position.y += camera.Height();
+			else if (p.position.y > camera.top)
+				p.position.y -= camera.Height();
+
+			if (p.lifetime > p.maxlifetime)
+				p.isAlive = false;
+		}
+	}
+
+	// the per entity work of BoxBattle::Step from before entities were split into arrays, the baseline for the box benchmark
+	void WrapBoxStructs(vector<BoxEntity>& entities, const bounds& camera) {
+		for (BoxEntity& ent : entities) {
+			if (!ent.isAlive) continue;
+			if (ent.position.x < camera.left)
+				ent.position.x += camera.Width();
+			else if (ent.position.x > camera.right)
+				ent.position.x -= camera.Width();
+
+			if (ent.position.y < camera.bottom)
+				ent.position.y += camera.Height();
+			else if (ent.position.y > camera.top)
+				ent.position.y -= camera.Height();
+
+			ent.ResetInterpolation();
+		}
+	}
+
+	void IntegrateBoxStructs(vector<BoxEntity>& entities, Timestep ts) {
+		constexpr float dragcoef = 0.994f;
+		for (BoxEntity& ent : entities) {
+			if (!ent.isAlive) continue;
+			ent.velocity *= dragcoef;
+			ent.angularvelocity *= dragcoef;
+			ent.position += ent.velocity * ts;
+			ent.rotation += ent.angularvelocity * ts;
+		}
+	}
+
+	struct WakeJob {
+		steady_clock::time_point ran;
+		std::atomic_bool done = false;
+	};
+
+	void RunWakeJob(void* value) {
+		WakeJob* job = static_cast<WakeJob*>(value);
+		job->ran = steady_clock::now();
+		job->done.store(true, std::memory_order_release);
+	}
+
+	void PrintParking(const char* name, const size_t workercount, const bool parking) {
+		cjs::work_queue queue;
+		std::unique_ptr<cjs::worker_thread[]> workers(new cjs::worker_thread[workercount]);
+		for (size_t i = 0; i < workercount; i++) {
+			workers[i].set_parking(parking);
+			workers[i].attach_to(&queue);
+		}
+
+		// cores kept busy while there is nothing to do, after giving the workers time to settle
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		const double cpustart = ProcessCpuSeconds();
+		const steady_clock::time_point start = steady_clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		const double idlecores = (ProcessCpuSeconds() - cpustart) / SecondsSince(start);
+
+		// one job at a time with enough of a gap for the workers to go idle again
+		vector<double> latencies;
+		for (size_t i = 0; i < 200; i++) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			WakeJob job;
+			const steady_clock::time_point submitted = steady_clock::now();
+			queue.submit(RunWakeJob, &job);
+			while (!job.done.load(std::memory_order_acquire)) std::this_thread::yield();
+			latencies.push_back(std::chrono::duration<double, std::micro>(job.ran - submitted).count());
+		}
+
+		for (size_t i = 0; i < workercount; i++) {
+			workers[i].attach_to(nullptr);
+		}
+		printf("%-8s  %10.2f  %9.1f  %9.1f  %9.1f\n", name, idlecores,
+			   Percentile(latencies, 0.5), Percentile(latencies, 0.9), Percentile(latencies, 0.99));
+	}
+
+	// stops and starts every worker rounds times, the way ParticleSystem used to every frame
+	template<typename Fence>
+	void PrintFence(const char* name, const size_t workercount, const bool parking, const size_t rounds) {
+		cjs::work_queue queue;
+		std::unique_ptr<cjs::worker_thread[]> workers(new cjs::worker_thread[workercount]);
+		for (size_t i = 0; i < workercount; i++) {
+			workers[i].set_parking(parking);
+			workers[i].attach_to(&queue);
+		}
+
+		const double cpustart = ProcessCpuSeconds();
+		const steady_clock::time_point start = steady_clock::now();
+		for (size_t i = 0; i < rounds; i++) {
+			Fence fence;
+			queue.submit(&fence);
+			fence.await_and_resume();
+		}
+		const double seconds = SecondsSince(start);
+		const double cores = (ProcessCpuSeconds() - cpustart) / seconds;
+
+		for (size_t i = 0; i < workercount; i++) {
+			workers[i].attach_to(nullptr);
+		}
+		printf("%-10s  %12.1f  %10.2f\n", name, seconds / rounds * 1000000.0, cores);
+	}
+
+}
+
+bool Benchmarks::RingTest() {
+	Checks checks;
+
+	// 3 regions of 8
+	{
+		VertexRing ring;
+		ring.Init(8, 3);
+		OGJ_CHECK(checks, ring.Capacity() == 24);
+		OGJ_CHECK(checks, ring.Region() == 0 && ring.Base() == 0);
+		OGJ_CHECK(checks, ring.Fits(8) && !ring.Fits(9));
+		OGJ_CHECK(checks, ring.Reserve(4) == 0);
+		OGJ_CHECK(checks, ring.Reserve(4) == 4);
+
+		// a full region still fits nothing
+		OGJ_CHECK(checks, ring.Fits(0) && !ring.Fits(1));
+		OGJ_CHECK(checks, ring.PendingFirst() == 0 && ring.PendingCount() == 8);
+		ring.MarkFlushed();
+		OGJ_CHECK(checks, ring.PendingFirst() == 8 && ring.PendingCount() == 0);
+
+		OGJ_CHECK(checks, ring.Advance() == 1);
+		OGJ_CHECK(checks, ring.Base() == 8 && ring.PendingFirst() == 8 && ring.PendingCount() == 0);
+		OGJ_CHECK(checks, ring.Fits(8));
+
+		// pending starts after the last flush
+		OGJ_CHECK(checks, ring.Reserve(2) == 8);
+		ring.MarkFlushed();
+		OGJ_CHECK(checks, ring.Reserve(3) == 10);
+		OGJ_CHECK(checks, ring.PendingFirst() == 10 && ring.PendingCount() == 3);
+
+		// the last region wraps back to the first
+		OGJ_CHECK(checks, ring.Advance() == 2 && ring.Base() == 16);
+		OGJ_CHECK(checks, ring.Advance() == 0 && ring.Base() == 0);
+		OGJ_CHECK(checks, ring.PendingFirst() == 0 && ring.PendingCount() == 0);
+		OGJ_CHECK(checks, ring.Reserve(8) == 0 && !ring.Fits(1));
+	}
+
+	// random frames with the gpu running behind, so the ring keeps coming back to regions that are still fenced
+	StreamWriter writer(64, 3, 40, checks);
+	Random random(1);
+	constexpr size_t frames = 5000;
+	for (size_t frame = 0; frame < frames; frame++) {
+		const size_t writes = random.Next() % 24;
+		for (size_t i = 0; i < writes; i++) {
+			// mostly a few quads, sometimes enough to fill a whole region
+			const size_t count = random.Next() % 16 == 0 ? 64 : (1 + random.Next() % 6) * 4;
+			writer.Write(count);
+		}
+		writer.EndFrame();
+		writer.stream.gpu.Run(random.Next() % 8);
+	}
+	writer.stream.WaitForAll();
+	FakeGpu& gpu = writer.stream.gpu;
+	gpu.Run(gpu.commands.size());
+
+	OGJ_CHECK(checks, gpu.draws == gpu.submitted);
+	// otherwise the fenced path was never taken
+	OGJ_CHECK(checks, gpu.waits > 0);
+
+	printf("ring test: %zu checks, %zu failed, %zu frames, %zu draws, %zu waits on fenced regions\n",
+		   checks.total, checks.failed, frames, gpu.draws, gpu.waits);
+	return checks.failed == 0;
+}
+
+bool Benchmarks::Queues(const size_t maxthreads) {
+	const bool workfence = FenceWithoutWorkers<cjs::work_queue, cjs::fence>(0);
+	const bool workslowfence = FenceWithoutWorkers<cjs::work_queue, cjs::slow_fence>(0);
+	const bool ringfence = FenceWithoutWorkers<cjs::ring_queue, cjs::fence>(4096);
+	const bool ringslowfence = FenceWithoutWorkers<cjs::ring_queue, cjs::slow_fence>(4096);
+	const auto result = [](const bool finished) { return finished ? "finished" : "never finished"; };
+	printf("fences with no workers    work_queue: %s, %s    ring_queue: %s, %s\n\n",
+		   result(workfence), result(workslowfence), result(ringfence), result(ringslowfence));
+
+	constexpr size_t jobsperproducer = 200000;
+	printf("queue throughput, %zu function jobs per producer (millions of jobs a second)\n", jobsperproducer);
+	printf("producers  workers      locked  work_queue  ring_queue\n");
+	for (size_t producers = 1; producers <= maxthreads; producers *= 2) {
+		for (size_t consumers = 1; consumers <= maxthreads; consumers *= 2) {
+			const double locked = QueueThroughput<LockedQueue>(producers, consumers, jobsperproducer, false);
+			const double workqueue = QueueThroughput<cjs::work_queue>(producers, consumers, jobsperproducer, true, 0);
+			const double ringqueue = QueueThroughput<cjs::ring_queue>(producers, consumers, jobsperproducer, true, 4096);
+			printf("%9zu  %7zu  %10.2f  %10.2f  %10.2f\n", producers, consumers, locked, workqueue, ringqueue);
+		}
+	}
+	return workfence && workslowfence && ringfence && ringslowfence;
+}
+
+void Benchmarks::Parking(const size_t workers) {
+	printf("%zu idle workers, wake up latency over 200 jobs (microseconds)\n", workers);
+	printf("mode      idle cores  p50 wake   p90 wake   p99 wake\n");
+	PrintParking("polling", workers, false);
+	PrintParking("parking", workers, true);
+
+	constexpr size_t rounds = 100;
+	printf("\n%zu fence rounds with %zu workers\n", rounds, workers);
+	printf("fence       round (us)    cores\n");
+	PrintFence<cjs::fence>("fence", workers, false, rounds);
+	PrintFence<cjs::slow_fence>("slow_fence", workers, true, rounds);
+}
+
+void Benchmarks::Particles() {
+	const bounds camera = GetWorld().camera;
+	const Timestep ts(1.0 / 60.0);
+	constexpr size_t steps = 60;
+	constexpr size_t counts[] = { 100000, 250000, 500000, 1000000 };
+
+	printf("one thread stepping particles %zu times (milliseconds a step)\n", steps);
+	printf("particles    structs     arrays  speedup\n");
+	for (const size_t count : counts) {
+		// the same particles in both layouts, some of them die part way through
+		vector<Particle> structs(count);
+		vector<float> x(count), y(count), vx(count), vy(count), lifetime(count, 0.0f), maxlifetime(count);
+		Random random(1);
+		for (size_t i = 0; i < count; i++) {
+			Particle& p = structs[i];
+			p.position = vec2(random.Range(camera.left, camera.right), random.Range(camera.bottom, camera.top));
+			p.velocity = vec2(random.Range(-5.0f, 5.0f), random.Range(-5.0f, 5.0f));
+			p.maxlifetime = random.Range(0.5f, 10.0f);
+			x[i] = p.position.x; y[i] = p.position.y;
+			vx[i] = p.velocity.x; vy[i] = p.velocity.y;
+			maxlifetime[i] = p.maxlifetime;
+		}
+
+		steady_clock::time_point start = steady_clock::now();
+		for (size_t i = 0; i < steps; i++) {
+			StepParticleStructs(ts, structs);
+		}
+		const double structsms = SecondsSince(start) * 1000.0 / steps;
+
+		const ParticleArrays arrays = { x.data(), y.data(), vx.data(), vy.data(), lifetime.data(), maxlifetime.data() };
+		vector<uint32> expired;
+		start = steady_clock::now();
+		for (size_t i = 0; i < steps; i++) {
+			expired.clear();
+			StepParticles(arrays, ts, camera, 0, count, expired);
+		}
+		const double arraysms = SecondsSince(start) * 1000.0 / steps;
+
+		printf("%9zu  %9.3f  %9.3f  %6.2fx\n", count, structsms, arraysms, structsms / arraysms);
+	}
+}
+
+void Benchmarks::BroadPhases() {
+	// collisions are detected on the workers
+	std::array<cjs::worker_thread, workercount> workers;
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].attach_to(&(GetWorld().jobqueue));
+	}
+	ParticleSystem::Init();
+	BoxBattle::Init();
+
+	const Timestep ts(1.0 / 60.0);
+	constexpr size_t steps = 10;
+	constexpr size_t counts[] = { 100, 1000, 10000 };
+	const struct {
+		BroadPhase broadphase;
+		const char* name;
+	} broadphases[] = {
+		{ BroadPhase::BruteForce, "nested loop" },
+		{ BroadPhase::Grid, "grid" },
+		{ BroadPhase::SweepAndPrune, "sweep" }
+	};
+
+	printf("BoxBattle::Step with scattered boxes, averaged over %zu steps\n", steps);
+	printf("boxes  broad phase   entities  pairs tested  nested loop pairs  step (ms)\n");
+	for (const size_t count : counts) {
+		for (const auto& phase : broadphases) {
+			// the same boxes for every broad phase, the two big boxes from Init are there too
+			SeedRandom(1);
+			BoxBattle::Reset();
+			ParticleSystem::Reset();
+			BoxBattle::SetBroadPhase(phase.broadphase);
+			BoxBattle::Scatter(count, 0.002f);
+			// adds the scattered boxes and gives the sweep its first sort
+			BoxBattle::Step(ts);
+
+			uint64 pairstested = 0;
+			uint64 bruteforcepairs = 0;
+			uint64 entities = 0;
+			const steady_clock::time_point start = steady_clock::now();
+			for (size_t i = 0; i < steps; i++) {
+				BoxBattle::Step(ts);
+				const BroadPhaseStats& stats = BoxBattle::GetBroadPhaseStats();
+				pairstested += stats.pairstested;
+				bruteforcepairs += stats.bruteforcepairs;
+				entities += stats.entities;
+			}
+			const double ms = SecondsSince(start) * 1000.0 / steps;
+
+			printf("%5zu  %-11s  %9llu  %12llu  %17llu  %9.3f\n", count, phase.name,
+				   static_cast<unsigned long long>(entities / steps), static_cast<unsigned long long>(pairstested / steps),
+				   static_cast<unsigned long long>(bruteforcepairs / steps), ms);
+		}
+	}
+
+	BoxBattle::SetBroadPhase(BroadPhase::SweepAndPrune);
+	BoxBattle::Exit();
+	ParticleSystem::Exit();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].attach_to(nullptr);
+	}
+}
+
+void Benchmarks::Boxes() {
+	const bounds camera = GetWorld().camera;
+	const Timestep ts(1.0 / 60.0);
+	constexpr size_t steps = 1000;
+	constexpr size_t counts[] = { 10000, 100000 };
+
+	printf("wrap and integrate passes of BoxBattle::Step, %zu steps (microseconds a step)\n", steps);
+	printf("    boxes    structs     arrays  speedup\n");
+	for (const size_t count : counts) {
+		// the same boxes in both layouts
+		vector<BoxEntity> structs(count);
+		vector<float> x(count), y(count), vx(count), vy(count), rotation(count), angularvelocity(count);
+		vector<float> lastx(count), lasty(count), lastrotation(count);
+		Random random(1);
+		for (size_t i = 0; i < count; i++) {
+			BoxEntity& ent = structs[i];
+			ent.position = vec2(random.Range(camera.left, camera.right), random.Range(camera.bottom, camera.top));
+			ent.velocity = vec2(random.Range(-5.0f, 5.0f), random.Range(-5.0f, 5.0f));
+			ent.rotation = random.Range(0.0f, 360.0f);
+			ent.angularvelocity = random.Range(-90.0f, 90.0f);
+			x[i] = ent.position.x; y[i] = ent.position.y;
+			vx[i] = ent.velocity.x; vy[i] = ent.velocity.y;
+			rotation[i] = ent.rotation;
+			angularvelocity[i] = ent.angularvelocity;
+		}
+
+		steady_clock::time_point start = steady_clock::now();
+		for (size_t i = 0; i < steps; i++) {
+			WrapBoxStructs(structs, camera);
+			IntegrateBoxStructs(structs, ts);
+		}
+		const double structsus = SecondsSince(start) * 1000000.0 / steps;
+
+		const BoxArrays arrays = { x.data(), y.data(), vx.data(), vy.data(), rotation.data(), angularvelocity.data(),
+								   lastx.data(), lasty.data(), lastrotation.data() };
+		start = steady_clock::now();
+		for (size_t i = 0; i < steps; i++) {
+			WrapBoxes(arrays, count, camera);
+			IntegrateBoxes(arrays, count, ts);
+		}
+		const double arraysus = SecondsSince(start) * 1000000.0 / steps;
+
+		printf("%9zu  %9.1f  %9.1f  %6.2fx\n", count, structsus, arraysus, structsus / arraysus);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef BENCHMARKS_HPP
+#define BENCHMARKS_HPP
+#include "General.hpp"
+#include "Core/Debugger.hpp"
+
+// checks and benchmarks run by the headless build instead of the simulation
+// everything prints its results to stdout
+class Benchmarks {
+	OGJ_NON_CONSTRUCTABLE(Benchmarks);
+public:
+
+	// streams through the VertexStream SpriteBatch uses, against a fake gpu that reads each draw late
+	// returns false if any check failed
+	static bool RingTest();
+
+	// submit and pop throughput of the old locked queue, work_queue and ring_queue
+	// for 1 to maxthreads producer threads against 1 to maxthreads workers
+	// returns false if a fence submitted to a queue with no workers never finished
+	static bool Queues(const size_t maxthreads);
+
+	// cpu used by idle workers, how long a job waits for a worker to wake up and fence round trips
+	// with parked workers and slow_fence against polling workers and the spinning fence
+	static void Parking(const size_t workers);
+
+	// one thread stepping 100k to 1M particles, the old vector<Particle> loop against the simd step over the particle arrays
+	static void Particles();
+
+	// BoxBattle::Step with 100, 1k and 10k small boxes for every broad phase, against the nested loop
+	static void BroadPhases();
+
+	// the wrap and integrate passes of BoxBattle::Step over 10k and 100k boxes
+	// the old vector<BoxEntity> loops against the passes over the box arrays
+	static void Boxes();
+
+};
+
+#endif // !BENCHMARKS_HPP
\ No newline at end of file
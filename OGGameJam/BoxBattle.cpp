@@ -1,57 +1,256 @@
 #include "BoxBattle.hpp"
-#include <glm\gtx\norm.hpp>
+#include <glm/gtx/norm.hpp>
 #include "BoxParticles.hpp"
+#include "Palette.hpp"
+#include "Core/Profiler.hpp"
+#include <algorithm>
+#include <mutex>
+#include <emmintrin.h>
 
 namespace {
 
-	uint32 selectedentity = -1;
+	EntityHandle selected;
 	uint32 laterfocus = -1;
 	vec2 relselectpos;
 	vec2 lastmousepos;
-	vector<BoxEntity> entities;
+
+	// entities stored as separate arrays so the passes over the whole world only pull in what they use
+	// live entities are packed together so loops dont step over dead ones
+	// an entity destroyed during a step keeps its place with alive cleared until RemoveDestroyed
+	struct BoxStore {
+		// hot, touched every step by the wrap and integrate passes
+		vector<float> x, y;
+		vector<float> vx, vy;
+		vector<float> rotation, angularvelocity;
+		// where each entity was at the start of the last step, drawing blends from here
+		vector<float> lastx, lasty, lastrotation;
+		// cold, collisions, updates and drawing
+		vector<bounds> box;
+		vector<vec4> color;
+		vector<float> colormix;
+		vector<float> lifetime;
+		vector<uint8> alive;
+		vector<uint32> slot;		// the slot its handles refer to
+
+		size_t size() const { return x.size(); }
+
+		vec2 Position(size_t i) const { return vec2(x[i], y[i]); }
+		vec2 Velocity(size_t i) const { return vec2(vx[i], vy[i]); }
+		void SetVelocity(size_t i, const vec2& v) { vx[i] = v.x; vy[i] = v.y; }
+
+		bounds GetBounds(size_t i) const {
+			return bounds(Position(i) + box[i].Min(), Position(i) + box[i].Max());
+		}
+
+		BoxArrays Arrays() {
+			return { x.data(), y.data(), vx.data(), vy.data(), rotation.data(), angularvelocity.data(),
+					 lastx.data(), lasty.data(), lastrotation.data() };
+		}
+
+		void Push(const BoxEntity& ent, uint32 slot_) {
+			x.push_back(ent.position.x); y.push_back(ent.position.y);
+			vx.push_back(ent.velocity.x); vy.push_back(ent.velocity.y);
+			rotation.push_back(ent.rotation);
+			angularvelocity.push_back(ent.angularvelocity);
+			lastx.push_back(ent.lastposition.x); lasty.push_back(ent.lastposition.y);
+			lastrotation.push_back(ent.lastrotation);
+			box.push_back(ent.box);
+			color.push_back(ent.color);
+			colormix.push_back(ent.colormix);
+			lifetime.push_back(ent.lifetime);
+			alive.push_back(ent.isAlive);
+			slot.push_back(slot_);
+		}
+
+		// copies the entity at from over the one at to
+		void Move(size_t from, size_t to) {
+			x[to] = x[from]; y[to] = y[from];
+			vx[to] = vx[from]; vy[to] = vy[from];
+			rotation[to] = rotation[from];
+			angularvelocity[to] = angularvelocity[from];
+			lastx[to] = lastx[from]; lasty[to] = lasty[from];
+			lastrotation[to] = lastrotation[from];
+			box[to] = box[from];
+			color[to] = color[from];
+			colormix[to] = colormix[from];
+			lifetime[to] = lifetime[from];
+			alive[to] = alive[from];
+			slot[to] = slot[from];
+		}
+
+		void PopBack() {
+			x.pop_back(); y.pop_back();
+			vx.pop_back(); vy.pop_back();
+			rotation.pop_back();
+			angularvelocity.pop_back();
+			lastx.pop_back(); lasty.pop_back();
+			lastrotation.pop_back();
+			box.pop_back();
+			color.pop_back();
+			colormix.pop_back();
+			lifetime.pop_back();
+			alive.pop_back();
+			slot.pop_back();
+		}
+	} entities;
+
+	// handles point at a slot, the slot knows where its entity currently is
+	struct EntitySlot {
+		uint32 index = 0;			// into entities
+		uint32 generation = 0;		// bumped every time the slot is freed
+	};
+	vector<EntitySlot> slots;
+	vector<uint32> freeslots;
+	vector<EntityHandle> destroyed;	// removed from entities by RemoveDestroyed
+
 	vector<BoxEntity> laterentities;
 	constexpr float dragcoef = 0.994f;
 
+	// oriented box geometry, rebuilt once per step before collisions so the pair tests need no trig
+	struct {
+		vector<float> cornerx, cornery;	// 4 per entity
+		vector<vec2> up, right;			// unit axes of each box
+		vector<bounds> aabb;			// bounds around the rotated box
+	} geometry;
+
+	// uniform grid over the camera, rebuilt every step
+	// cells wrap around the camera edges the same way entities do
+	struct {
+		uint32 columns = 0;
+		uint32 rows = 0;
+		vec2 cellsize = vec2(0.0f);
+		vector<uint32> cellstart;		// per cell offset into cellentities, has one extra entry at the end
+		vector<uint32> cellcursor;
+		vector<uint32> cellentities;	// entity indices sorted by cell
+	} grid;
+
+	// a pair of boxes found overlapping by the detection pass, i < j
+	struct Contact {
+		uint32 i;
+		uint32 j;
+		bool operator<(const Contact& other) const {
+			return i < other.i || (i == other.i && j < other.j);
+		}
+	};
+	// filled by the detection chunks as they finish, sorted before any merge is done
+	std::mutex contactslock;
+	vector<Contact> contacts;
+	constexpr size_t detectgrain = 32;
+	constexpr float targetcellsize = 2.0f;
+
+	// sweep and prune, entries stay sorted by the left edge of their box from one step to the next
+	// boxes barely move between steps so the insertion sort only has a few swaps to make
+	struct SweepEntry {
+		uint32 slot;
+		uint32 generation;
+		uint32 index;	// into entities, refreshed every step
+		float left;
+		float right;
+	};
+	struct {
+		vector<SweepEntry> entries;
+		vector<SweepEntry> moved;		// new and wrapped boxes, merged in after the sort
+		vector<uint8> listed;			// per slot, whether it still has an entry
+		vector<Contact> pairs;
+		vector<uint32> rowstart;		// per entity offset into rowentities, has one extra entry at the end
+		vector<uint32> rowentities;		// the entities after each entity that it overlaps, sorted
+	} sweep;
+
+	BroadPhase broadphase = BroadPhase::SweepAndPrune;
+	BroadPhaseStats broadstats;
+
 }
 
 // entity functions
 void UpdateBox(uint32 index, Timestep ts);
 void Explode(uint32 index);
 
+EntityHandle GetHandle(uint32 index) {
+	const uint32 slot = entities.slot[index];
+	return EntityHandle(slot, slots[slot].generation);
+}
+
+// returns the index of the entity the handle refers to, or -1 when it has been destroyed
+uint32 Resolve(const EntityHandle& handle) {
+	if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation) return -1;
+	const uint32 index = slots[handle.slot].index;
+	return entities.alive[index] ? index : -1;
+}
+
+bool IsSelected(uint32 index) {
+	return selected == GetHandle(index);
+}
+
 void Select(uint32 index) {
-	selectedentity = index;
+	selected = GetHandle(index);
 	auto& world = GetWorld();
-	auto& ent = entities[index];
-	float rad = glm::radians(ent.rotation);
-	relselectpos = glm::rotate(ent.box.Clamp(glm::rotate(world.mouse.worldpos - ent.position, rad)), -rad);
+	float rad = glm::radians(entities.rotation[index]);
+	relselectpos = glm::rotate(entities.box[index].Clamp(glm::rotate(world.mouse.worldpos - entities.Position(index), rad)), -rad);
 	lastmousepos = world.mouse.worldpos;
-	ent.velocity = vec2(0.0f);
-	ent.angularvelocity = 0.0f;
+	entities.SetVelocity(index, vec2(0.0f));
+	entities.angularvelocity[index] = 0.0f;
 }
 void Deselect() {
-	if (selectedentity != -1) {
-		selectedentity = -1;
-	}
+	selected = EntityHandle();
 }
 
 void Collide(uint32 e0index, uint32 e1index);
+void DetectContacts(size_t begin, size_t end);
+void BuildGeometry();
+void OverlapBatch(uint32 index, const vector<uint32>& candidates, vector<uint32>& hits);
+
+// broadphase functions
+void BuildGrid(const bounds& camera);
+void GatherPairs(uint32 index, vector<uint32>& out);
+void BuildSweep(const bounds& camera);
+void GatherSweepPairs(uint32 index, vector<uint32>& out);
 
+// the entity stays in place until RemoveDestroyed so indices held by the current loop stay valid
 void Destroy(uint32 index) {
-	if (selectedentity == index) {
-		selectedentity = -1;
+	if (IsSelected(index)) Deselect();
+	entities.alive[index] = false;
+	destroyed.push_back(GetHandle(index));
+}
+
+// adds the entity to the end of entities and returns its index, valid until the next RemoveDestroyed
+uint32 Create(const BoxEntity& ent) {
+	uint32 slot;
+	if (!freeslots.empty()) {
+		slot = freeslots.back();
+		freeslots.pop_back();
+	} else {
+		slot = slots.size();
+		slots.emplace_back();
 	}
-	entities[index].isAlive = false;
+	slots[slot].index = entities.size();
+	entities.Push(ent, slot);
+	return entities.size() - 1;
 }
 
-uint32 Create() {
-	for (size_t i = 0; i < entities.size(); i++) {
-		if (!entities[i].isAlive) {
-			new (&entities[i]) BoxEntity();
-			return i;
+// moves the last entity into the place of every destroyed one and frees their slots
+void RemoveDestroyed() {
+	for (const EntityHandle& handle : destroyed) {
+		EntitySlot& slot = slots[handle.slot];
+		// an entity can be destroyed twice in one step, the second handle is already stale
+		if (slot.generation != handle.generation) continue;
+		const uint32 index = slot.index;
+		const uint32 last = entities.size() - 1;
+		if (index != last) {
+			entities.Move(last, index);
+			slots[entities.slot[index]].index = index;
 		}
+		entities.PopBack();
+		++slot.generation;
+		freeslots.push_back(handle.slot);
 	}
-	entities.push_back(BoxEntity());
-	return entities.size() - 1;
+	destroyed.clear();
+}
+
+void DestroyAll() {
+	for (uint32 i = 0; i < entities.size(); i++) {
+		Destroy(i);
+	}
+	RemoveDestroyed();
 }
 
 void AddLater(BoxEntity& e, bool shouldlaterfocus = false) {
@@ -61,8 +260,7 @@ void AddLater(BoxEntity& e, bool shouldlaterfocus = false) {
 
 void DoAddLater() {
 	for (size_t i = 0; i < laterentities.size(); i++) {
-		uint32 ent = Create();
-		entities[ent] = std::move(laterentities[i]);
+		uint32 ent = Create(laterentities[i]);
 		if (laterfocus == i) {
 			laterfocus = -1;
 			Select(ent);
@@ -71,6 +269,40 @@ void DoAddLater() {
 	laterentities.clear();
 }
 
+// branchless so the compiler can run it a few boxes at a time
+void WrapBoxes(const BoxArrays& boxes, const size_t count, const bounds& camera) {
+	float* x = boxes.x;
+	float* y = boxes.y;
+	const float width = camera.Width();
+	const float height = camera.Height();
+	for (size_t i = 0; i < count; i++) {
+		x[i] += (x[i] < camera.left ? width : 0.0f) - (x[i] > camera.right ? width : 0.0f);
+		y[i] += (y[i] < camera.bottom ? height : 0.0f) - (y[i] > camera.top ? height : 0.0f);
+	}
+	// after wrapping, so a box crossing the edge isnt drawn sliding across the screen
+	std::copy(x, x + count, boxes.lastx);
+	std::copy(y, y + count, boxes.lasty);
+	std::copy(boxes.rotation, boxes.rotation + count, boxes.lastrotation);
+}
+
+void IntegrateBoxes(const BoxArrays& boxes, const size_t count, Timestep ts) {
+	float* x = boxes.x;
+	float* y = boxes.y;
+	float* vx = boxes.vx;
+	float* vy = boxes.vy;
+	float* rotation = boxes.rotation;
+	float* angularvelocity = boxes.angularvelocity;
+	const float dt = ts;
+	for (size_t i = 0; i < count; i++) {
+		vx[i] *= dragcoef;
+		vy[i] *= dragcoef;
+		angularvelocity[i] *= dragcoef;
+		x[i] += vx[i] * dt;
+		y[i] += vy[i] * dt;
+		rotation[i] += angularvelocity[i] * dt;
+	}
+}
+
 void BoxBattle::Init() {
 	//auto& ent = entities[Create()];
 	//ent.velocity = vec2(1.5f, 1.5f);
@@ -80,59 +312,50 @@ void BoxBattle::Init() {
 	//entities.push_back(ent);
 
 	for (size_t i = 0; i < 2; i++) {
-		auto& ent = entities[Create()];
+		BoxEntity ent;
 		ent.box = bounds(5.0f, 5.0f);
 		if (i == 0) ent.position = vec2(-5.0f, 0.0f);
 		else ent.position = vec2(5.0f, 0.0f);
+		ent.ResetInterpolation();
+		Create(ent);
 	}
 
 }
 
 void BoxBattle::Reset() {
 	Deselect();
-	entities.clear();
+	DestroyAll();
 	laterentities.clear();
 	Init();
 }
 
 void BoxBattle::Exit() {
-	entities.clear();
+	DestroyAll();
+	sweep.entries.clear();
+	slots.clear();
+	freeslots.clear();
 }
 
 void BoxBattle::Step(Timestep ts) {
+	OGJ_PROFILE_ZONE("BoxBattle::Step");
 	World& world = GetWorld();
 	bounds& camera = world.camera;
 
 	DoAddLater();
 
-	for (size_t i = 0; i < entities.size(); i++) {
-		auto& ent = entities[i];
-		if (!ent.isAlive) continue;
-		ent.lifetime += ts;
-
-		bool losefocus = true;
-
-		if (ent.position.x < camera.left)
-			ent.position.x += camera.Width();
-		else if (ent.position.x > camera.right)
-			ent.position.x -= camera.Width();
-		else losefocus = false;
-
-		if (losefocus && selectedentity == i) Deselect();
-		losefocus = true;
-
-		if (ent.position.y < camera.bottom)
-			ent.position.y += camera.Height();
-		else if (ent.position.y > camera.top)
-			ent.position.y -= camera.Height();
-		else losefocus = false;
-
-		if (losefocus && selectedentity == i) Deselect();
+	// a box dragged off the edge is let go before it wraps
+	const uint32 selectedindex = Resolve(selected);
+	if (selectedindex != -1 && !camera.Contains(entities.Position(selectedindex)))
+		Deselect();
+	WrapBoxes(entities.Arrays(), entities.size(), camera);
 
+	// only ever appended to here, an entity can only destroy itself
+	for (size_t i = 0; i < entities.size(); i++) {
+		entities.lifetime[i] += ts;
 
-		if (world.mouse.left.waspressed && (selectedentity == -1)) {
-			bounds b = ent.GetBounds();
-			if (b.Contains(world.mouse.worldpos, ent.rotation)) {
+		if (world.mouse.left.waspressed && (Resolve(selected) == -1)) {
+			bounds b = entities.GetBounds(i);
+			if (b.Contains(world.mouse.worldpos, entities.rotation[i])) {
 				Select(i);
 			}
 		}
@@ -141,123 +364,154 @@ void BoxBattle::Step(Timestep ts) {
 
 	}
 
-	for (size_t i = 0; i < entities.size(); i++) {
-		if (!entities[i].isAlive) continue;
-		for (size_t j = i + 1; j < entities.size(); j++) {
-			if (entities[j].isAlive) {
-				Collide(i, j);
-			}
-		}
-		auto& ent = entities[i];
+	// the boxes that exploded are gone, so everything left is alive when collisions start
+	RemoveDestroyed();
+
+	// every pair is tested before either box moves
+	broadstats = BroadPhaseStats();
+	broadstats.entities = entities.size();
+	BuildGeometry();
+	if (broadphase == BroadPhase::Grid) BuildGrid(camera);
+	else if (broadphase == BroadPhase::SweepAndPrune) BuildSweep(camera);
+
+	// detection only reads, so the rows are split over the workers
+	contacts.clear();
+	cjs::parallel_for(world.jobqueue, 0, entities.size(), detectgrain, DetectContacts, workercount);
+
+	// chunks finish in any order, sorting makes the merges the same every run
+	// a box merges at most once a step, the first contact in index order wins
+	std::sort(contacts.begin(), contacts.end());
+	for (const Contact& contact : contacts) {
+		if (entities.alive[contact.i] && entities.alive[contact.j])
+			Collide(contact.i, contact.j);
+	}
 
-		ent.velocity *= dragcoef;
-		ent.angularvelocity *= dragcoef;
-		ent.position += ent.velocity * ts;
-		ent.rotation += ent.angularvelocity * ts;
+	broadstats.bruteforcepairs = broadstats.entities * (broadstats.entities - 1) / 2;
 
-		if (selectedentity == i) {
-			// rotate around relative pos
-			relselectpos = glm::rotate(relselectpos, glm::radians(-ent.angularvelocity * ts));
-		}
+	IntegrateBoxes(entities.Arrays(), entities.size(), ts);
+	RemoveDestroyed();
 
+	const uint32 heldindex = Resolve(selected);
+	if (heldindex != -1) {
+		// rotate around relative pos
+		relselectpos = glm::rotate(relselectpos, glm::radians(-entities.angularvelocity[heldindex] * ts));
 	}
 
-	if (world.mouse.left.isheld && (selectedentity != -1)) {
-		auto& ent = entities[selectedentity];
-		if (!ent.isAlive) {
-			Deselect();
-			return;
-		}
+	if (world.mouse.left.isheld && (heldindex != -1)) {
+		const vec2 position = entities.Position(heldindex);
 
 		float mousedelta = glm::length(lastmousepos - world.mouse.worldpos) * 10.0f;
 		lastmousepos = world.mouse.worldpos;
 
 		// calculate linear velocity
 		vec2 targetpos = world.mouse.worldpos - relselectpos;
-		vec2 dir = (targetpos - ent.position) * 0.2f;
-		ent.velocity += dir + dir * mousedelta;
+		vec2 dir = (targetpos - position) * 0.2f;
+		entities.SetVelocity(heldindex, entities.Velocity(heldindex) + dir + dir * mousedelta);
 
 		// calculate angular velocity
+		const bounds& box = entities.box[heldindex];
 		const float force = glm::dot(glm::normalize(vec2(-relselectpos.y, relselectpos.x)), dir);
 		const float radius = glm::length(relselectpos);
-		vec2 halfsize(ent.box.Width() * 0.5f, ent.box.Height() * 0.5f);
-		const float amount = glm::length((world.mouse.worldpos - ent.position) / halfsize) * 0.5f;
+		vec2 halfsize(box.Width() * 0.5f, box.Height() * 0.5f);
+		const float amount = glm::length((world.mouse.worldpos - position) / halfsize) * 0.5f;
 		if (fabs(force) > 0.000001f)
-			ent.angularvelocity += radius * -force * 100.0f * amount;
+			entities.angularvelocity[heldindex] += radius * -force * 100.0f * amount;
 
 	} else {
 		Deselect();
 	}
 }
 
-void BoxBattle::Draw() {
+void BoxBattle::Draw(const float alpha) {
+	OGJ_PROFILE_ZONE("BoxBattle::Draw");
 	World& world = GetWorld();
 	bounds& camera = world.camera;
 
 	DoAddLater();
 
 	for (size_t i = 0; i < entities.size(); i++) {
-		auto& ent = entities[i];
-		if (!ent.isAlive) continue;
-		bounds b = ent.GetBounds();
-		vec2 half(b.Width() * 0.5f, b.Height() * 0.5f);
-		b.min -= half;
-		b.max += half;
+		const vec2 position = glm::mix(vec2(entities.lastx[i], entities.lasty[i]), entities.Position(i), alpha);
+		const float rotation = glm::mix(entities.lastrotation[i], entities.rotation[i], alpha);
+		const bounds& box = entities.box[i];
+		const vec4& entcolor = entities.color[i];
+		const vec2 half = box.Size() * 0.5f;
+		const bounds b(position + box.Min() - half, position + box.Max() + half);
 
-		SpriteBatch::DrawQuad(ent.position, ent.box, ent.color, ent.rotation);
+		SpriteBatch::DrawQuad(position, box, entcolor, rotation);
 
 		if (b.left < camera.left) {
-			vec4 color = ent.color;
-			vec2 pos = ent.position;
+			vec4 color = entcolor;
+			vec2 pos = position;
 			pos.x += camera.Width();
 			color.a = 0.2f;
-			SpriteBatch::DrawQuad(pos, ent.box, color, ent.rotation);
+			SpriteBatch::DrawQuad(pos, box, color, rotation);
 		} else if (b.right > camera.right) {
-			vec4 color = ent.color;
-			bounds b0 = b;
-			vec2 pos = ent.position;
+			vec4 color = entcolor;
+			vec2 pos = position;
 			pos.x -= camera.Width();
 			color.a = 0.2f;
-			SpriteBatch::DrawQuad(pos, ent.box, color, ent.rotation);
+			SpriteBatch::DrawQuad(pos, box, color, rotation);
 		}
 
 		if (b.bottom < camera.bottom) {
-			vec4 color = ent.color;
-			vec2 pos = ent.position;
+			vec4 color = entcolor;
+			vec2 pos = position;
 			pos.y += camera.Height();
 			color.a = 0.2f;
-			SpriteBatch::DrawQuad(pos, ent.box, color, ent.rotation);
+			SpriteBatch::DrawQuad(pos, box, color, rotation);
 		} else if (b.top > camera.top) {
-			vec4 color = ent.color;
-			vec2 pos = ent.position;
+			vec4 color = entcolor;
+			vec2 pos = position;
 			pos.y -= camera.Height();
 			color.a = 0.2f;
-			SpriteBatch::DrawQuad(pos, ent.box, color, ent.rotation);
+			SpriteBatch::DrawQuad(pos, box, color, rotation);
 		}
 
 	}
 }
 
 vec2 BoxBattle::GetSelectedPos() {
-	if (selectedentity != -1)
-		return relselectpos + entities[selectedentity].position;
+	const uint32 index = Resolve(selected);
+	if (index != -1)
+		return relselectpos + entities.Position(index);
 	return vec2(INFINITY);
 }
 
+void BoxBattle::Scatter(const size_t count, const float area) {
+	const bounds& camera = GetWorld().camera;
+	for (size_t i = 0; i < count; i++) {
+		BoxEntity ent;
+		ent.box = bounds::MakeFromArea(area);
+		ent.position = vec2(RandomRange(camera.left, camera.right), RandomRange(camera.bottom, camera.top));
+		ent.velocity = vec2(RandomRange(-1.0f, 1.0f), RandomRange(-1.0f, 1.0f));
+		ent.rotation = RandomRange(0.0f, 360.0f);
+		ent.ResetInterpolation();
+		AddLater(ent);
+	}
+}
+
+void BoxBattle::SetBroadPhase(const BroadPhase broadphase_) {
+	broadphase = broadphase_;
+}
+
+const BroadPhaseStats& BoxBattle::GetBroadPhaseStats() {
+	return broadstats;
+}
+
 void UpdateBox(uint32 index, Timestep ts) {
 	//const static vec4 colorA = vec4(1.0f, 0.0f, 0.0f, 1.0f);
 	const static vec4 colorB = vec4(1.0f, 1.0f, 1.0f, 1.0f);
 	float maxspeed = 60.0f;
 	float maxspeedinverse = 1.0f / maxspeed;
 
-	float len = glm::length(entities[index].velocity);
+	float len = glm::length(entities.Velocity(index));
 	float delta = len * maxspeedinverse;
-	float area = entities[index].box.Area();
+	float area = entities.box[index].Area();
 
-	entities[index].colormix += ts * delta;
-	vec4 colorA = ColorMix(entities[index].colormix);
+	entities.colormix[index] += ts * delta;
+	vec4 colorA = Palette::Color(entities.colormix[index]);
 
-	entities[index].color = colorA;
+	entities.color[index] = colorA;
 	//if (len > maxspeed) entities[index].color = colorA;
 	//else if (len < 9.0f) entities[index].color = colorB;
 	//else entities[index].color = glm::mix(colorB, colorA, (len - 9.0f) / (maxspeed - 9.0f));
@@ -269,93 +523,369 @@ void UpdateBox(uint32 index, Timestep ts) {
 }
 
 void Explode(uint32 index) {
-	bounds box = bounds::MakeFromArea(entities[index].box.Area() * 0.25f);
+	bounds box = bounds::MakeFromArea(entities.box[index].Area() * 0.25f);
 	vec2 quart(box.Width(), box.Height());
+	const vec2 position = entities.Position(index);
+	const vec2 velocity = entities.Velocity(index);
+	const float rotation = entities.rotation[index];
+	const float angularvelocity = entities.angularvelocity[index];
 	for (size_t i = 0; i < 4; i++) {
-		uint32 nindex = Create();
-		auto& nent = entities[nindex];
+		BoxEntity nent;
 
-		vec2 offset = glm::rotate(quart, glm::radians(entities[index].rotation + 90.0f * float(i))) * 1.25f;
-		nent.position = entities[index].position + offset * 1.12f;
-		nent.rotation = entities[index].rotation;
+		vec2 offset = glm::rotate(quart, glm::radians(rotation + 90.0f * float(i))) * 1.25f;
+		nent.position = position + offset * 1.12f;
+		nent.rotation = rotation;
 
 		offset = glm::normalize(offset);
-		nent.velocity = (entities[index].velocity + offset * glm::length(entities[index].velocity) * 0.1f) * 0.5f;
-		nent.angularvelocity = entities[index].angularvelocity * glm::dot(glm::normalize(entities[index].velocity), offset);
+		nent.velocity = (velocity + offset * glm::length(velocity) * 0.1f) * 0.5f;
+		nent.angularvelocity = angularvelocity * glm::dot(glm::normalize(velocity), offset);
 		nent.box = box;
+		nent.ResetInterpolation();
+		Create(nent);
 
 	}
 
-	ParticleSystem::BoxExplode(entities[index].GetBounds(), entities[index].rotation, entities[index].colormix, entities[index].velocity);
+	ParticleSystem::BoxExplode(entities.GetBounds(index), rotation, entities.colormix[index], velocity);
 	Destroy(index);
 }
 
-std::tuple<float, float> GetBoxRange(BoxPoints& points, const vec2& axis) {
-	float min = FLT_MAX;
-	float max = -FLT_MAX;
-	for (size_t i = 0; i < points.size(); i++) {
-		float val = glm::dot(points[i], axis);
-		min = glm::min(val, min);
-		max = glm::max(val, max);
+// works out the corners, axes and bounds of every box once, with one sin and cos each
+void BuildGeometry() {
+	const size_t count = entities.size();
+	geometry.cornerx.resize(count * 4);
+	geometry.cornery.resize(count * 4);
+	geometry.up.resize(count);
+	geometry.right.resize(count);
+	geometry.aabb.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		// rotation is in degrees and turns the box clockwise, the same way SpriteBatch::DrawQuad draws it
+		const float rad = -glm::radians(entities.rotation[i]);
+		const vec2 right(glm::cos(rad), glm::sin(rad));
+		const vec2 up(-right.y, right.x);
+		const vec2 position = entities.Position(i);
+		const bounds& box = entities.box[i];
+		const vec2 corners[4] = {
+			position + right * box.left + up * box.bottom,
+			position + right * box.left + up * box.top,
+			position + right * box.right + up * box.top,
+			position + right * box.right + up * box.bottom
+		};
+		vec2 min = corners[0], max = corners[0];
+		for (size_t k = 0; k < 4; k++) {
+			geometry.cornerx[i * 4 + k] = corners[k].x;
+			geometry.cornery[i * 4 + k] = corners[k].y;
+			min = glm::min(min, corners[k]);
+			max = glm::max(max, corners[k]);
+		}
+		geometry.up[i] = up;
+		geometry.right[i] = right;
+		geometry.aabb[i] = bounds(min, max);
 	}
-	return { min, max };
 }
 
-bool NearZero(float a) {
-	return fabs(a) < 0.001f;
-}
+// lanes where the two boxes dont overlap on axis
+// one of the two boxes needs its lowest point inside the range of the other, and the overlap has to be more than a hair
+static __m128 SeparatedOnAxis(const __m128* ax, const __m128* ay, const __m128* bx, const __m128* by, __m128 axisx, __m128 axisy) {
+	__m128 min0 = _mm_add_ps(_mm_mul_ps(ax[0], axisx), _mm_mul_ps(ay[0], axisy));
+	__m128 max0 = min0;
+	__m128 min1 = _mm_add_ps(_mm_mul_ps(bx[0], axisx), _mm_mul_ps(by[0], axisy));
+	__m128 max1 = min1;
+	for (size_t k = 1; k < 4; k++) {
+		const __m128 d0 = _mm_add_ps(_mm_mul_ps(ax[k], axisx), _mm_mul_ps(ay[k], axisy));
+		const __m128 d1 = _mm_add_ps(_mm_mul_ps(bx[k], axisx), _mm_mul_ps(by[k], axisy));
+		min0 = _mm_min_ps(min0, d0);
+		max0 = _mm_max_ps(max0, d0);
+		min1 = _mm_min_ps(min1, d1);
+		max1 = _mm_max_ps(max1, d1);
+	}
+
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 in0 = _mm_and_ps(_mm_cmplt_ps(min0, max1), _mm_cmpgt_ps(min0, min1));
+	const __m128 in1 = _mm_and_ps(_mm_cmplt_ps(min1, max0), _mm_cmpgt_ps(min1, min0));
+	const __m128 depth0 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(max1, half), _mm_mul_ps(min1, half)), min0);
+	const __m128 depth1 = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(max0, half), _mm_mul_ps(min0, half)), min1);
+	const __m128 depth = _mm_or_ps(_mm_and_ps(in0, depth0), _mm_andnot_ps(in0, _mm_and_ps(in1, depth1)));
 
-float BoxOverlapAxis(BoxPoints& p0, BoxPoints& p1, const vec2& axis) {
-	auto [min0, max0] = GetBoxRange(p0, axis);
-	auto [min1, max1] = GetBoxRange(p1, axis);
-	if (min0 < max1 && min0 > min1) return glm::mix(max1, min1, 0.5f) - min0;
-	if (min1 < max0 && min1 > min0) return glm::mix(max0, min0, 0.5f) - min1;
-	return 0.0f;
+	const __m128 absdepth = _mm_andnot_ps(_mm_set1_ps(-0.0f), depth);
+	return _mm_cmplt_ps(absdepth, _mm_set1_ps(0.001f));
 }
 
-void Collide(uint32 e0index, uint32 e1index) {
-	BoxEntity& e0 = entities[e0index];
-	BoxEntity& e1 = entities[e1index];
+// tests the box at index against every candidate four at a time, the ones it overlaps go to hits in candidate order
+void OverlapBatch(uint32 index, const vector<uint32>& candidates, vector<uint32>& hits) {
+	hits.clear();
+	const float* cornerx = geometry.cornerx.data();
+	const float* cornery = geometry.cornery.data();
 
-	if (fabs(glm::length(e0.velocity)) > 10.0f || fabs(glm::length(e1.velocity)) > 10.0f) return;
+	__m128 ax[4], ay[4];
+	for (size_t k = 0; k < 4; k++) {
+		ax[k] = _mm_set1_ps(cornerx[index * 4 + k]);
+		ay[k] = _mm_set1_ps(cornery[index * 4 + k]);
+	}
+	const __m128 up0x = _mm_set1_ps(geometry.up[index].x);
+	const __m128 up0y = _mm_set1_ps(geometry.up[index].y);
+	const __m128 right0x = _mm_set1_ps(geometry.right[index].x);
+	const __m128 right0y = _mm_set1_ps(geometry.right[index].y);
+
+	for (size_t c = 0; c < candidates.size(); c += 4) {
+		// a short last group repeats its first candidate, the extra lanes are masked off
+		const size_t lanes = glm::min(candidates.size() - c, size_t(4));
+		uint32 other[4];
+		for (size_t l = 0; l < 4; l++) {
+			other[l] = candidates[c + (l < lanes ? l : 0)];
+		}
 
-	auto p0 = e0.GetBoxPoints();
-	auto p1 = e1.GetBoxPoints();
+		__m128 bx[4], by[4];
+		for (size_t k = 0; k < 4; k++) {
+			bx[k] = _mm_setr_ps(cornerx[other[0] * 4 + k], cornerx[other[1] * 4 + k], cornerx[other[2] * 4 + k], cornerx[other[3] * 4 + k]);
+			by[k] = _mm_setr_ps(cornery[other[0] * 4 + k], cornery[other[1] * 4 + k], cornery[other[2] * 4 + k], cornery[other[3] * 4 + k]);
+		}
+		const __m128 up1x = _mm_setr_ps(geometry.up[other[0]].x, geometry.up[other[1]].x, geometry.up[other[2]].x, geometry.up[other[3]].x);
+		const __m128 up1y = _mm_setr_ps(geometry.up[other[0]].y, geometry.up[other[1]].y, geometry.up[other[2]].y, geometry.up[other[3]].y);
+		const __m128 right1x = _mm_setr_ps(geometry.right[other[0]].x, geometry.right[other[1]].x, geometry.right[other[2]].x, geometry.right[other[3]].x);
+		const __m128 right1y = _mm_setr_ps(geometry.right[other[0]].y, geometry.right[other[1]].y, geometry.right[other[2]].y, geometry.right[other[3]].y);
+
+		__m128 separated = SeparatedOnAxis(ax, ay, bx, by, up1x, up1y);
+		separated = _mm_or_ps(separated, SeparatedOnAxis(ax, ay, bx, by, right1x, right1y));
+		separated = _mm_or_ps(separated, SeparatedOnAxis(ax, ay, bx, by, up0x, up0y));
+		separated = _mm_or_ps(separated, SeparatedOnAxis(ax, ay, bx, by, right0x, right0y));
+
+		const int overlapping = ~_mm_movemask_ps(separated) & ((1 << lanes) - 1);
+		for (size_t l = 0; l < lanes; l++) {
+			if (overlapping & (1 << l)) hits.push_back(other[l]);
+		}
+	}
+}
 
-	vec2 up1 = e1.UpAxis();
-	float a = BoxOverlapAxis(p0, p1, up1);
-	if (NearZero(a)) return;
+// boxes this fast pass through each other instead of merging
+bool TooFastToMerge(uint32 index) {
+	return fabs(glm::length(entities.Velocity(index))) > 10.0f;
+}
 
-	vec2 right1 = e1.RightAxis();
-	float b = BoxOverlapAxis(p0, p1, right1);
-	if (NearZero(b)) return;
+// finds every pair of boxes that should merge with rows in [begin, end), runs on the workers
+// reads the entities, geometry and broad phase only, what it finds goes to contacts
+void DetectContacts(size_t begin, size_t end) {
+	thread_local vector<uint32> candidates;
+	thread_local vector<uint32> hits;
+	thread_local vector<Contact> found;
+	found.clear();
+	uint32 tested = 0;
+
+	for (size_t i = begin; i < end; i++) {
+		if (TooFastToMerge(i)) continue;
+		switch (broadphase) {
+			case BroadPhase::Grid: GatherPairs(i, candidates); break;
+			case BroadPhase::SweepAndPrune: GatherSweepPairs(i, candidates); break;
+			default:
+				candidates.clear();
+				for (size_t j = i + 1; j < entities.size(); j++) {
+					candidates.push_back(j);
+				}
+				break;
+		}
+		tested += candidates.size();
 
-	vec2 up0 = e0.UpAxis();
-	float c = BoxOverlapAxis(p0, p1, up0);
-	if (NearZero(c)) return;
+		OverlapBatch(i, candidates, hits);
+		for (uint32 j : hits) {
+			if (!TooFastToMerge(j)) found.push_back({ static_cast<uint32>(i), j });
+		}
+	}
 
-	vec2 right0 = e0.RightAxis();
-	float d = BoxOverlapAxis(p0, p1, right0);
-	if (NearZero(d)) return;
+	std::lock_guard<std::mutex> _(contactslock);
+	contacts.insert(contacts.end(), found.begin(), found.end());
+	broadstats.pairstested += tested;
+}
+
+// merges two overlapping boxes into one
+void Collide(uint32 e0index, uint32 e1index) {
+	const vec2 position0 = entities.Position(e0index);
+	const vec2 position1 = entities.Position(e1index);
+	const vec2 velocity0 = entities.Velocity(e0index);
+	const float rotation0 = entities.rotation[e0index];
+	const float rotation1 = entities.rotation[e1index];
 
 	// colliding
 	BoxEntity ent;
 	ent.isAlive = true;
-	ent.color = glm::mix(e0.color, e1.color, 0.5f);
-	ent.position = glm::mix(e0.position, e1.position, 0.5f);
-	ent.velocity = glm::mix(e0.velocity, e1.position, 0.5f);
-	ent.box = bounds::MakeFromArea(e0.box.Area() + e1.box.Area());
+	ent.color = glm::mix(entities.color[e0index], entities.color[e1index], 0.5f);
+	ent.position = glm::mix(position0, position1, 0.5f);
+	ent.velocity = glm::mix(velocity0, position1, 0.5f);
+	ent.box = bounds::MakeFromArea(entities.box[e0index].Area() + entities.box[e1index].Area());
 	//ent.box.min *= 0.75f;
 	//ent.box.max *= 0.75f;
-	ent.rotation = glm::mix(e0.rotation, e1.rotation, 0.5f);
-	ent.angularvelocity = glm::mix(e0.angularvelocity, e1.angularvelocity, 0.5f);
-	ent.colormix = glm::mix(e0.colormix, e1.colormix, 0.5f);
-	AddLater(ent, (e0index == selectedentity) || (e1index == selectedentity));
+	ent.rotation = glm::mix(rotation0, rotation1, 0.5f);
+	ent.angularvelocity = glm::mix(entities.angularvelocity[e0index], entities.angularvelocity[e1index], 0.5f);
+	ent.colormix = glm::mix(entities.colormix[e0index], entities.colormix[e1index], 0.5f);
+	ent.ResetInterpolation();
+	AddLater(ent, IsSelected(e0index) || IsSelected(e1index));
 	//SpriteBatch::DrawQuad(glm::mix(e0.position, ent.position, 0.5f), ent.box, ent.color * 0.5f, glm::mix(e0.rotation, ent.rotation, 0.5f));
 	//SpriteBatch::DrawQuad(glm::mix(e1.position, ent.position, 0.5f), ent.box, ent.color * 0.5f, glm::mix(e1.rotation, ent.rotation, 0.5f));
-	ParticleSystem::BoxMerge(entities[e0index].GetBounds(), entities[e0index].rotation, entities[e0index].colormix,
-							 entities[e1index].GetBounds(), entities[e1index].rotation, entities[e1index].colormix,
+	ParticleSystem::BoxMerge(entities.GetBounds(e0index), rotation0, entities.colormix[e0index],
+							 entities.GetBounds(e1index), rotation1, entities.colormix[e1index],
 							 ent.GetBounds(), glm::length(ent.velocity));
 	Destroy(e0index);
 	Destroy(e1index);
 }
+
+// wraps a (possibly negative) cell coordinate into [0, count)
+uint32 WrapCell(float cell, uint32 count) {
+	float wrapped = fmodf(cell, static_cast<float>(count));
+	if (wrapped < 0.0f) wrapped += static_cast<float>(count);
+	return glm::min(static_cast<uint32>(wrapped), count - 1);
+}
+
+// calls callable with every cell index that b overlaps, wrapping around the camera edges
+template<typename Callable>
+void ForEachCell(const bounds& b, const bounds& camera, Callable callable) {
+	const vec2 first = glm::floor((b.Min() - camera.Min()) / grid.cellsize);
+	const vec2 last = glm::floor((b.Max() - camera.Min()) / grid.cellsize);
+
+	// a span wider than the grid would visit cells twice
+	const uint32 spanx = (last.x - first.x) >= grid.columns ? grid.columns : static_cast<uint32>(last.x - first.x) + 1;
+	const uint32 spany = (last.y - first.y) >= grid.rows ? grid.rows : static_cast<uint32>(last.y - first.y) + 1;
+	const uint32 startx = WrapCell(first.x, grid.columns);
+	const uint32 starty = WrapCell(first.y, grid.rows);
+
+	for (uint32 y = 0; y < spany; y++) {
+		const uint32 row = ((starty + y) % grid.rows) * grid.columns;
+		for (uint32 x = 0; x < spanx; x++) {
+			callable(row + (startx + x) % grid.columns);
+		}
+	}
+}
+
+void BuildGrid(const bounds& camera) {
+	grid.columns = glm::max(static_cast<uint32>(camera.Width() / targetcellsize), 1u);
+	grid.rows = glm::max(static_cast<uint32>(camera.Height() / targetcellsize), 1u);
+	grid.cellsize = vec2(camera.Width() / grid.columns, camera.Height() / grid.rows);
+	const uint32 cellcount = grid.columns * grid.rows;
+	broadstats.cells = cellcount;
+
+	grid.cellstart.assign(cellcount + 1, 0);
+
+	// count how many entities touch each cell
+	for (size_t i = 0; i < entities.size(); i++) {
+		ForEachCell(geometry.aabb[i], camera, [](uint32 cell) {
+			++grid.cellstart[cell + 1];
+		});
+	}
+
+	// turn the counts into offsets
+	for (uint32 i = 0; i < cellcount; i++) {
+		grid.cellstart[i + 1] += grid.cellstart[i];
+	}
+
+	// fill the cells, entities end up in index order within each cell
+	grid.cellentities.resize(grid.cellstart[cellcount]);
+	grid.cellcursor.assign(grid.cellstart.begin(), grid.cellstart.end() - 1);
+	for (size_t i = 0; i < entities.size(); i++) {
+		const uint32 index = i;
+		ForEachCell(geometry.aabb[i], camera, [index](uint32 cell) {
+			grid.cellentities[grid.cellcursor[cell]++] = index;
+		});
+	}
+}
+
+// collects every entity after index whose bounds overlap it, sorted so pairs are tested in the same order as the nested loop
+// Collide works on unwrapped positions so pairs that only touch across the camera edge are skipped here too
+// only reads the grid so the detection chunks can call it at the same time
+void GatherPairs(uint32 index, vector<uint32>& out) {
+	const bounds& camera = GetWorld().camera;
+	const bounds& b = geometry.aabb[index];
+	out.clear();
+	ForEachCell(b, camera, [index, &b, &out](uint32 cell) {
+		for (uint32 i = grid.cellstart[cell]; i < grid.cellstart[cell + 1]; i++) {
+			const uint32 other = grid.cellentities[i];
+			if (other <= index) continue;
+			if (bounds::Intersects(b, geometry.aabb[other]))
+				out.push_back(other);
+		}
+	});
+	// an entity spanning several of the cells is found once for each
+	std::sort(out.begin(), out.end());
+	out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+static bool SweepLess(const SweepEntry& a, const SweepEntry& b) {
+	return a.left < b.left;
+}
+
+// brings the sorted entries up to date with this steps geometry and finds every overlapping pair
+// boxes are swept where they are like Collide sees them, so pairs that only touch across the camera edge are skipped here too
+void BuildSweep(const bounds& camera) {
+	vector<SweepEntry>& entries = sweep.entries;
+	sweep.moved.clear();
+	sweep.listed.assign(slots.size(), 0);
+
+	// drop boxes that are gone and refresh the rest
+	// a box that wrapped jumps to the other end of the list, swapping it along would touch every entry in between
+	const float wrapdistance = camera.Width() * 0.5f;
+	size_t kept = 0;
+	for (size_t e = 0; e < entries.size(); e++) {
+		SweepEntry entry = entries[e];
+		if (entry.slot >= slots.size() || slots[entry.slot].generation != entry.generation) continue;
+		entry.index = slots[entry.slot].index;
+		const bounds& aabb = geometry.aabb[entry.index];
+		const bool wrapped = fabs(aabb.left - entry.left) > wrapdistance;
+		entry.left = aabb.left;
+		entry.right = aabb.right;
+		sweep.listed[entry.slot] = 1;
+		if (wrapped) sweep.moved.push_back(entry);
+		else entries[kept++] = entry;
+	}
+	entries.resize(kept);
+
+	for (size_t i = 0; i < entities.size(); i++) {
+		const uint32 slot = entities.slot[i];
+		if (sweep.listed[slot]) continue;
+		const bounds& aabb = geometry.aabb[i];
+		sweep.moved.push_back({ slot, slots[slot].generation, static_cast<uint32>(i), aabb.left, aabb.right });
+	}
+
+	// nearly sorted already
+	uint32 swaps = 0;
+	for (size_t e = 1; e < entries.size(); e++) {
+		const SweepEntry entry = entries[e];
+		size_t k = e;
+		for (; k > 0 && entries[k - 1].left > entry.left; k--) {
+			entries[k] = entries[k - 1];
+			++swaps;
+		}
+		entries[k] = entry;
+	}
+
+	std::sort(sweep.moved.begin(), sweep.moved.end(), SweepLess);
+	const size_t middle = entries.size();
+	entries.insert(entries.end(), sweep.moved.begin(), sweep.moved.end());
+	std::inplace_merge(entries.begin(), entries.begin() + middle, entries.end(), SweepLess);
+	broadstats.swaps = swaps;
+	broadstats.reinserted = sweep.moved.size();
+
+	// every later entry that starts before this one ends overlaps it along x
+	sweep.pairs.clear();
+	for (size_t a = 0; a < entries.size(); a++) {
+		const bounds& b = geometry.aabb[entries[a].index];
+		for (size_t e = a + 1; e < entries.size() && entries[e].left <= entries[a].right; e++) {
+			const uint32 i = entries[a].index;
+			const uint32 j = entries[e].index;
+			if (bounds::Intersects(b, geometry.aabb[j]))
+				sweep.pairs.push_back({ std::min(i, j), std::max(i, j) });
+		}
+	}
+
+	// grouped by the lower entity so the detection chunks can read their rows
+	std::sort(sweep.pairs.begin(), sweep.pairs.end());
+	sweep.rowstart.assign(entities.size() + 1, 0);
+	sweep.rowentities.resize(sweep.pairs.size());
+	for (size_t p = 0; p < sweep.pairs.size(); p++) {
+		++sweep.rowstart[sweep.pairs[p].i + 1];
+		sweep.rowentities[p] = sweep.pairs[p].j;
+	}
+	for (size_t i = 0; i < entities.size(); i++) {
+		sweep.rowstart[i + 1] += sweep.rowstart[i];
+	}
+}
+
+// every entity after index whose bounds overlap it, in the same order as GatherPairs
+void GatherSweepPairs(uint32 index, vector<uint32>& out) {
+	out.assign(sweep.rowentities.begin() + sweep.rowstart[index], sweep.rowentities.begin() + sweep.rowstart[index + 1]);
+}
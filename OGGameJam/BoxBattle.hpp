@@ -1,35 +1,13 @@
 #ifndef BOXBATTLE_HPP
 #define BOXBATTLE_HPP
-#include "Core\Timer.hpp"
+#include "Core/Timer.hpp"
 #include "SpriteBatch.hpp"
 #include "World.hpp"
-#include <glm\gtx\rotate_vector.hpp>
+#include <glm/gtx/rotate_vector.hpp>
 #include <array>
 #include "General.hpp"
 
-struct BoxPoints final {
-
-	BoxPoints() : m_points{ vec2(0.0f) } { }
-	BoxPoints(const vec2& a, const vec2& b, const vec2& c, const vec2& d)
-		: m_points{ a, b, c, d } { }
-
-	vec2& operator[](const size_t index) {
-		return m_points[index];
-	}
-	const vec2& operator[] (const size_t index) const {
-		return m_points[index];
-	}
-
-	vec2 center() const {
-		return glm::mix(glm::mix(m_points[0], m_points[1], 0.5f),
-						glm::mix(m_points[2], m_points[3], 0.5f), 0.5f);
-	}
-
-	constexpr size_t size() { return 4; }
-private:
-	vec2 m_points[4];
-};
-
+// a whole entity, BoxBattle keeps them split into separate arrays and uses this to create them
 struct BoxEntity {
 	bool isAlive = true;
 	vec4 color = vec4(1.0f);
@@ -42,30 +20,68 @@ struct BoxEntity {
 	float angularvelocity = 0.0f;
 	bounds box = bounds(-0.5f, -0.5f, 0.5f, 0.5f);
 
-	bounds GetBounds() const {
-		bounds b;
-		b.min = position + box.min;
-		b.max = position + box.max;
-		return b;
-	}
+	// where the entity was at the start of the last step, drawing blends from here to the current position
+	vec2 lastposition = vec2(0.0f);
+	float lastrotation = 0.0f;
 
-	BoxPoints GetBoxPoints() const {
-		const float rad = -glm::radians(rotation);
-		return {
-			glm::rotate(box.min, rad) + position,
-			glm::rotate(vec2(box.min.x, box.max.y), rad) + position,
-			glm::rotate(box.max, rad) + position,
-			glm::rotate(vec2(box.max.x, box.min.y), rad) + position
-		};
+	// starts interpolating from where the entity is now, call after placing a new entity
+	void ResetInterpolation() {
+		lastposition = position;
+		lastrotation = rotation;
 	}
 
-	vec2 UpAxis() const {
-		return glm::normalize(glm::rotate(vec2(0.0f, 1.0f), glm::radians(-rotation)));
+	bounds GetBounds() const {
+		return bounds(position + box.Min(), position + box.Max());
 	}
+};
 
-	vec2 RightAxis() const {
-		return glm::normalize(glm::rotate(vec2(1.0f, 0.0f), glm::radians(-rotation)));
-	}
+// the arrays the per entity passes of BoxBattle::Step run over, BoxBattle keeps one of each
+struct BoxArrays {
+	float* x;
+	float* y;
+	float* vx;
+	float* vy;
+	float* rotation;
+	float* angularvelocity;
+	float* lastx;
+	float* lasty;
+	float* lastrotation;
+};
+
+// wraps every box back onto the camera and starts interpolating from there
+void WrapBoxes(const BoxArrays& boxes, const size_t count, const bounds& camera);
+
+// applies drag then moves and turns every box by its velocity
+void IntegrateBoxes(const BoxArrays& boxes, const size_t count, Timestep ts);
+
+// refers to an entity by slot and generation, it goes stale once the entity is destroyed even if the slot is reused
+struct EntityHandle {
+	uint32 slot = -1;
+	uint32 generation = 0;
+
+	EntityHandle() = default;
+	EntityHandle(const uint32 slot_, const uint32 generation_)
+		: slot(slot_), generation(generation_) { }
+
+	bool operator==(const EntityHandle& other) const { return slot == other.slot && generation == other.generation; }
+	bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+// how BoxBattle finds the pairs it hands to the SAT test
+enum class BroadPhase {
+	BruteForce,		// every live pair
+	Grid,			// uniform grid over the camera, rebuilt every step
+	SweepAndPrune	// boxes kept sorted along x from one step to the next
+};
+
+// collision stats from the last BoxBattle::Step
+struct BroadPhaseStats {
+	uint32 entities = 0;
+	uint32 cells = 0;
+	uint32 pairstested = 0;		// pairs handed to the SAT test
+	uint32 bruteforcepairs = 0;	// pairs the nested loop would have tested
+	uint32 swaps = 0;			// sweep and prune, neighbours the insertion sort swapped
+	uint32 reinserted = 0;		// sweep and prune, new and wrapped boxes merged in instead of swapped along
 };
 
 struct BoxBattle {
@@ -75,10 +91,17 @@ struct BoxBattle {
 	static void Exit();
 
 	static void Step(Timestep ts);
-	static void Draw();
+	// alpha is how far the frame is between the last step and the next one
+	static void Draw(const float alpha = 1.0f);
 
 	static vec2 GetSelectedPos();
 
+	// adds count boxes of the given area at random places on the camera, for stressing the step
+	static void Scatter(const size_t count, const float area);
+
+	static void SetBroadPhase(const BroadPhase broadphase);
+	static const BroadPhaseStats& GetBroadPhaseStats();
+
 };
 
 #endif // !BOXBATTLE_HPP
\ No newline at end of file
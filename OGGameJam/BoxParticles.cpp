@@ -1,66 +1,268 @@
 #include "BoxParticles.hpp"
 #include "World.hpp"
+#include "Palette.hpp"
+#include "Core/Profiler.hpp"
 #include <atomic>
 #include <functional>
 #include <mutex>
-#include <array>
+#include <algorithm>
+#include <emmintrin.h>
 
 namespace {
 
-	vector<Particle> particles;
+	// particles stored as separate arrays so the step can run 4 at a time
+	// a particle is alive while lifetime <= maxlifetime, dead slots get a negative maxlifetime
+	struct ParticleStore {
+		// hot, touched every step
+		vector<float> x, y;
+		vector<float> vx, vy;
+		vector<float> lifetime, maxlifetime;
+		// cold, only used for drawing
+		vector<float> colormixoffset;
+		vector<float> rotation;
+		vector<bounds> box;
+
+		size_t size() const { return x.size(); }
+
+		bool IsAlive(size_t i) const { return lifetime[i] <= maxlifetime[i]; }
+
+		ParticleArrays Arrays() {
+			return { x.data(), y.data(), vx.data(), vy.data(), lifetime.data(), maxlifetime.data() };
+		}
+
+		void Kill(size_t i) {
+			lifetime[i] = 0.0f;
+			maxlifetime[i] = -1.0f;
+		}
+
+		void Resize(size_t count) {
+			const size_t oldsize = size();
+			x.resize(count); y.resize(count);
+			vx.resize(count); vy.resize(count);
+			lifetime.resize(count); maxlifetime.resize(count);
+			colormixoffset.resize(count);
+			rotation.resize(count);
+			box.resize(count);
+			for (size_t i = oldsize; i < count; i++) Kill(i);
+		}
+
+		void Clear() {
+			Resize(0);
+		}
+
+		void Set(size_t i, const Particle& p) {
+			x[i] = p.position.x; y[i] = p.position.y;
+			vx[i] = p.velocity.x; vy[i] = p.velocity.y;
+			lifetime[i] = p.lifetime;
+			maxlifetime[i] = p.maxlifetime;
+			colormixoffset[i] = p.colormixoffset;
+			rotation[i] = p.rotation;
+			box[i] = p.box;
+			if (!p.isAlive) Kill(i);
+		}
+	};
+
+	ParticleStore particles;
 	bounds particlebounds(0.1f, 0.1f);
 	constexpr float dragcoef = 0.994f;
 
 	Timestep timestep;
+	float drawalpha = 1.0f;
+
+	using functype = std::function<void(size_t, Particle&, const float*)>;
 
-	using functype = std::function<void(size_t, Particle&)>;
-	using guard = std::lock_guard<std::mutex>;
-	std::mutex spawnslock;
+	// free particle slots, only touched by the main thread while no particle jobs are running
+	struct SlotAllocator {
+		vector<uint32> freeslots;
 
-	struct ParticleJob : cjs::ijob {
-		size_t begin = 0;
-		size_t end = 0;
+		void Release(uint32 index) {
+			freeslots.push_back(index);
+		}
 
-		void execute() override;
+		// takes count slots, growing the store when there arent enough free ones
+		void Acquire(size_t count, vector<uint32>& out) {
+			if (freeslots.size() < count) {
+				const size_t oldsize = particles.size();
+				const size_t newsize = glm::max(oldsize * 2, oldsize + count - freeslots.size());
+				particles.Resize(newsize);
+				// pushed in reverse so the lowest slots are handed out first
+				for (size_t i = newsize; i-- > oldsize;) {
+					freeslots.push_back(i);
+				}
+			}
+			out.assign(freeslots.end() - count, freeslots.end());
+			freeslots.resize(freeslots.size() - count);
+		}
+
+		// marks every slot as free
+		void Reset() {
+			freeslots.clear();
+			for (size_t i = particles.size(); i-- > 0;) {
+				freeslots.push_back(i);
+			}
+		}
+	} slots;
+
+	// steps and draws one chunk of the particle loop, or only draws it when step is false
+	struct StepChunk {
+		bool step = true;
+		void operator()(size_t begin, size_t end) const;
 	};
 
-	struct SpawnJob : cjs::ijob {
-		std::atomic_bool complete = false;
-		size_t count;
+	// what one chunk left behind, chunks finish in any order so these are sorted by begin before use
+	struct ChunkResult {
+		size_t begin;
+		size_t drawcount; // quads written to drawlist starting at begin
+	};
+
+	struct SpawnJob : cjs::graph_job {
+		vector<uint32> slots;
 		functype callable;
+		uint64 seed = 0; // handed out by the main thread so spawns dont depend on which worker runs them
+		vector<vec2> randomranges; // min and max of each random value the callable gets
+		vector<float> randoms; // one column per range, count values each
+		vector<float> values; // the random values of the particle being spawned
+
+		void run() override;
+	};
 
-		void execute() override;
+	// the step jobs wait on this instead of on every spawn job
+	struct SpawnBarrier : cjs::graph_job {
+		void run() override { }
 	};
 
-	std::array<ParticleJob, workercount> jobs;
+	struct PendingSpawn {
+		size_t count;
+		functype callable;
+		vector<vec2> randomranges;
+	};
+
+	// chunks stay a multiple of 4 so each one runs whole simd groups
+	constexpr size_t stepgrain = 256;
+	cjs::parallel_for_job<StepChunk> steploop(workercount);
 	std::vector<std::shared_ptr<SpawnJob>> spawns;
-	cjs::fence particlefence;
+	std::vector<PendingSpawn> pendingspawns;
+	SpawnBarrier spawnbarrier;
+
+	// every particle job of the current step, EndStep waits on just these
+	cjs::job_group particlegroup;
+
+	// built by the chunks right after they step, each chunk writes only to [begin, end)
+	// so the chunks never share a range
+	vector<quadinstance> drawlist;
+
+	// filled in by the chunks as they finish, a chunk takes the lock once
+	std::mutex resultslock;
+	vector<ChunkResult> chunkresults;
+	vector<uint32> expired; // slots that died during this step
 
 }
 
-static void Step(Timestep ts, size_t index, Particle& p);
-static void DoSpawn(size_t count, functype callable);
+static size_t BuildDrawList(size_t begin, size_t end, float alpha, quadinstance* out);
+static void ReclaimExpired();
+static size_t PrepareSpawns();
+
+void StepParticles(const ParticleArrays& particles, Timestep ts, const bounds& camera, size_t begin, size_t end, vector<uint32>& expired) {
+	float* x = particles.x;
+	float* y = particles.y;
+	float* vx = particles.vx;
+	float* vy = particles.vy;
+	float* lifetime = particles.lifetime;
+	const float* maxlifetime = particles.maxlifetime;
+	const float dt = ts;
+	const float width = camera.Width();
+	const float height = camera.Height();
+
+	size_t i = begin;
+
+	const __m128 dt4 = _mm_set1_ps(dt);
+	const __m128 drag4 = _mm_set1_ps(dragcoef);
+	const __m128 left4 = _mm_set1_ps(camera.left);
+	const __m128 right4 = _mm_set1_ps(camera.right);
+	const __m128 bottom4 = _mm_set1_ps(camera.bottom);
+	const __m128 top4 = _mm_set1_ps(camera.top);
+	const __m128 width4 = _mm_set1_ps(width);
+	const __m128 height4 = _mm_set1_ps(height);
+	for (; i + 4 <= end; i += 4) {
+		__m128 px = _mm_loadu_ps(x + i);
+		__m128 py = _mm_loadu_ps(y + i);
+		__m128 pvx = _mm_loadu_ps(vx + i);
+		__m128 pvy = _mm_loadu_ps(vy + i);
+
+		px = _mm_add_ps(px, _mm_mul_ps(pvx, dt4));
+		py = _mm_add_ps(py, _mm_mul_ps(pvy, dt4));
+
+		// wrap, at most one of the two masks is set per lane
+		px = _mm_add_ps(px, _mm_and_ps(_mm_cmplt_ps(px, left4), width4));
+		px = _mm_sub_ps(px, _mm_and_ps(_mm_cmpgt_ps(px, right4), width4));
+		py = _mm_add_ps(py, _mm_and_ps(_mm_cmplt_ps(py, bottom4), height4));
+		py = _mm_sub_ps(py, _mm_and_ps(_mm_cmpgt_ps(py, top4), height4));
+
+		_mm_storeu_ps(x + i, px);
+		_mm_storeu_ps(y + i, py);
+		_mm_storeu_ps(vx + i, _mm_mul_ps(pvx, drag4));
+		_mm_storeu_ps(vy + i, _mm_mul_ps(pvy, drag4));
+
+		const __m128 oldlife = _mm_loadu_ps(lifetime + i);
+		const __m128 newlife = _mm_add_ps(oldlife, dt4);
+		const __m128 maxlife = _mm_loadu_ps(maxlifetime + i);
+		_mm_storeu_ps(lifetime + i, newlife);
+
+		// alive before the step and dead after it
+		int died = _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(oldlife, maxlife), _mm_cmpgt_ps(newlife, maxlife)));
+		for (uint32 lane = 0; died; lane++, died >>= 1) {
+			if (died & 1) expired.push_back(i + lane);
+		}
+	}
 
-static void Step(Timestep ts, size_t index, Particle& p) {
-	if (!p.isAlive) return;
-	bounds camera = GetWorld().camera;
+	// leftovers
+	for (; i < end; i++) {
+		x[i] += vx[i] * dt;
+		y[i] += vy[i] * dt;
+		vx[i] *= dragcoef;
+		vy[i] *= dragcoef;
+		const bool wasalive = lifetime[i] <= maxlifetime[i];
+		lifetime[i] += dt;
+		if (wasalive && lifetime[i] > maxlifetime[i]) expired.push_back(i);
+
+		if (x[i] < camera.left) x[i] += width;
+		else if (x[i] > camera.right) x[i] -= width;
+
+		if (y[i] < camera.bottom) y[i] += height;
+		else if (y[i] > camera.top) y[i] -= height;
+	}
+}
 
-	p.position += p.velocity * ts;
-	p.velocity *= dragcoef;
-	p.lifetime += ts;
+// writes a quad for every live particle in [begin, end) to out and returns how many were written
+// positions are blended back towards where the last step started, alpha 1 draws them where they are now
+static size_t BuildDrawList(size_t begin, size_t end, float alpha, quadinstance* out) {
+	// the step moved each particle by its velocity before drag, so this undoes the part of it the frame hasnt reached
+	// wrapping doesnt matter, the offset never jumps across the screen
+	const float back = (1.0f - alpha) * timestep.Get() / dragcoef;
 
-	if (p.position.x < camera.left)
-		p.position.x += camera.Width();
-	else if (p.position.x > camera.right)
-		p.position.x -= camera.Width();
+	// colors are packed in one batch once the live particles are known
+	thread_local vector<float> mixes;
+	thread_local vector<uint32> colors;
+	mixes.clear();
 
-	if (p.position.y < camera.bottom)
-		p.position.y += camera.Height();
-	else if (p.position.y > camera.top)
-		p.position.y -= camera.Height();
+	size_t count = 0;
+	for (size_t i = begin; i < end; i++) {
+		if (!particles.IsAlive(i)) continue;
+		quadinstance& quad = out[count++];
+		const bounds& box = particles.box[i];
+		quad.position = vec2(particles.x[i] - particles.vx[i] * back, particles.y[i] - particles.vy[i] * back);
+		quad.box = vec4(box.left, box.bottom, box.right, box.top);
+		// same angle the old DrawQuad call ended up with, it converted the already converted rotation again
+		quad.rotation = -glm::radians(-glm::radians(particles.rotation[i]));
+		mixes.push_back(particles.lifetime[i] + particles.colormixoffset[i]);
+	}
 
-	if (p.lifetime > p.maxlifetime)
-		p.isAlive = false;
+	colors.resize(count);
+	Palette::Packed(mixes.data(), colors.data(), count);
+	for (size_t i = 0; i < count; i++) {
+		out[i].color = colors[i];
+	}
+	return count;
 }
 
 //static void Loop() {
@@ -91,136 +293,169 @@ static void Step(Timestep ts, size_t index, Particle& p) {
 //	}
 //}
 
-static void DoSpawn(size_t count, functype callable) {
-	// spawn using existing particles
-	for (size_t i = 0; i < particles.size() && count > 0; i++) {
-		if (!particles[i].isAlive) {
-			new (&particles[i]) Particle();
-			--count;
-			callable(i, particles[i]);
-		}
-	}
-	// reserve more memory as needed
-	if (count > (particles.capacity() - particles.size())) {
-		particles.reserve(particles.capacity() * 2);
-	}
-	// emplace some more as needed
-	while (count > 0) {
-		particles.emplace_back();
-		callable(particles.size() - 1, particles[particles.size() - 1]);
-		--count;
+void SpawnJob::run() {
+	// the slots were handed out on the main thread so spawn jobs never touch the same particle
+	Random& random = GetThreadRandom();
+	random.Seed(seed);
+
+	// every random value of the spawn is made up front, a column at a time
+	const size_t count = slots.size();
+	const size_t columns = randomranges.size();
+	randoms.resize(count * columns);
+	values.resize(columns);
+	for (size_t c = 0; c < columns; c++) {
+		random.Fill(randoms.data() + c * count, count, randomranges[c].x, randomranges[c].y);
 	}
-}
 
-void SpawnJob::execute() {
-	guard _(spawnslock);
-	// spawn using existing particles
-	for (size_t i = 0; i < particles.size() && count > 0; i++) {
-		if (!particles[i].isAlive) {
-			new (&particles[i]) Particle();
-			--count;
-			callable(i, particles[i]);
+	for (size_t i = 0; i < count; i++) {
+		for (size_t c = 0; c < columns; c++) {
+			values[c] = randoms[c * count + i];
 		}
+		Particle p;
+		callable(i, p, values.data());
+		particles.Set(slots[i], p);
 	}
-	//// reserve more memory as needed
-	//if (count > (particles.capacity() - particles.size())) {
-	//	particles.reserve(particles.capacity() * 2);
-	//}
-	//// emplace some more as needed
-	//while (count > 0) {
-	//	particles.emplace_back();
-	//	callable(particles.size() - 1, particles[particles.size() - 1]);
-	//	--count;
-	//}
-	complete = true;
 }
 
-void ParticleJob::execute() {
-	for (size_t i = begin; i < end; i++) {
-		Step(timestep, i, particles[i]);
-	}
+void StepChunk::operator()(size_t begin, size_t end) const {
+	thread_local vector<uint32> chunkexpired;
+	chunkexpired.clear();
+	if (step)
+		StepParticles(particles.Arrays(), timestep, GetWorld().camera, begin, end, chunkexpired);
+	const size_t drawcount = BuildDrawList(begin, end, drawalpha, drawlist.data() + begin);
+
+	std::lock_guard<std::mutex> _(resultslock);
+	chunkresults.push_back({ begin, drawcount });
+	expired.insert(expired.end(), chunkexpired.begin(), chunkexpired.end());
 }
 
+// queues count particles to be spawned at the start of the next step
+// callable gets the index of the particle within this spawn, from 0 to count
+// and one random value for each of randomranges, each range is given as (min, max)
 template<typename Callable>
-static void Spawn(size_t count, Callable callable) {
-	//guard _(spawnslock);
-	//schedualedspawns.emplace_back(count, callable);
-	for (size_t i = 0; i < spawns.size(); i++) {
-		if (spawns[i]->complete) {
-			spawns[i]->complete = false;
-			spawns[i]->callable = callable;
-			spawns[i]->count = count;
-			GetWorld().jobqueue.submit(spawns[i].get());
-			return;
-		}
+static void Spawn(size_t count, Callable callable, std::initializer_list<vec2> randomranges = {}) {
+	if (count == 0) return;
+	pendingspawns.push_back({ count, callable, randomranges });
+}
+
+// puts the slots of every particle that died last step back on the free list
+static void ReclaimExpired() {
+	// chunks report in whatever order they finish, sorting keeps slot reuse the same from run to run
+	std::sort(expired.begin(), expired.end(), std::greater<uint32>());
+	for (uint32 index : expired) {
+		slots.Release(index);
 	}
-	std::shared_ptr<SpawnJob> spjob(new SpawnJob());
-	spjob->complete = false;
-	spjob->callable = callable;
-	spjob->count = count;
-	GetWorld().jobqueue.submit(spjob.get());
-	spawns.push_back(spjob);
+	expired.clear();
 }
 
-void ParticleSystem::Init() {
-	particles.clear();
-	particles.resize(2000);
-	for (size_t i = 0; i < particles.size(); i++) {
-		particles[i].isAlive = false;
+// hands out slots for every pending spawn and sets up the jobs to fill them in
+// the jobs are not submitted, spawnbarrier is made to depend on them
+// returns how many spawn jobs are ready
+static size_t PrepareSpawns() {
+	for (size_t i = 0; i < pendingspawns.size(); i++) {
+		if (i == spawns.size())
+			spawns.emplace_back(new SpawnJob());
+		auto& spjob = spawns[i];
+		spjob->reset();
+		slots.Acquire(pendingspawns[i].count, spjob->slots);
+		spjob->callable = std::move(pendingspawns[i].callable);
+		spjob->randomranges.swap(pendingspawns[i].randomranges);
+		spjob->seed = GetThreadRandom().Next64();
+		spawnbarrier.depends_on(*spjob);
 	}
+	const size_t count = pendingspawns.size();
+	pendingspawns.clear();
+	return count;
+}
+
+void ParticleSystem::Init() {
+	particles.Clear();
+	particles.Resize(2000);
+	slots.Reset();
 }
 
 void ParticleSystem::Reset() {
-	auto& world = GetWorld();
-	particlefence.await_and_resume();
+	particlegroup.wait();
 	for (size_t i = 0; i < particles.size(); i++) {
-		particles[i].isAlive = false;
+		particles.Kill(i);
 	}
+	expired.clear();
+	chunkresults.clear();
+	slots.Reset();
 	spawns.clear();
-	world.jobqueue.submit(&particlefence);
+	pendingspawns.clear();
 }
 
 void ParticleSystem::Exit() {
-	particles.clear();
+	particles.Clear();
+	drawlist.clear();
+	slots.freeslots.clear();
 	spawns.clear();
+	pendingspawns.clear();
 }
 
-void ParticleSystem::StartStep(Timestep ts) {
+void ParticleSystem::StartStep(Timestep ts, const float alpha) {
+	OGJ_PROFILE_ZONE("ParticleSystem::StartStep");
 	auto& world = GetWorld();
 
-	world.jobqueue.submit(&particlefence);
-	particlefence.await_and_resume();
+	particlegroup.wait();
+
+	// no particle jobs are running, so the free list and the store can be changed safely
+	ReclaimExpired();
+	spawnbarrier.reset();
+	const size_t spawncount = PrepareSpawns();
 
 	timestep = ts;
+	drawalpha = alpha;
+	drawlist.resize(particles.size());
+
+	chunkresults.clear();
+
+	// spawn jobs write to any slot so the step runs after all of them
+	steploop.reset();
+	steploop.set(0, particles.size(), stepgrain, StepChunk());
+	if (spawncount > 0)
+		steploop.depends_on(spawnbarrier);
 
-	size_t range = particles.size() / jobs.size();
-	for (size_t i = 0; i < jobs.size(); i++) {
-		jobs[i].begin = range * i;
-		if ((i + 1) != jobs.size())
-			jobs[i].end = jobs[i].begin + range;
-		else
-			jobs[i].end = particles.size();
-		world.jobqueue.submit(&(jobs[i]));
+	// every dependency is set, so the order these go in doesnt matter
+	for (size_t i = 0; i < spawncount; i++) {
+		spawns[i]->submit_to(world.jobqueue, particlegroup);
 	}
-	world.jobqueue.submit(&particlefence);
+	if (spawncount > 0)
+		spawnbarrier.submit_to(world.jobqueue, particlegroup);
+	steploop.submit_to(world.jobqueue, particlegroup);
 }
 
-void ParticleSystem::EndStep() {
+void ParticleSystem::StartRedraw(const float alpha) {
+	OGJ_PROFILE_ZONE("ParticleSystem::StartRedraw");
 	auto& world = GetWorld();
-	particlefence.await_and_resume();
+
+	particlegroup.wait();
+
+	// pending spawns wait for the next step, the particles havent moved so nothing expires
+	drawalpha = alpha;
+	chunkresults.clear();
+	steploop.reset();
+	steploop.set(0, particles.size(), stepgrain, StepChunk{ false });
+	steploop.submit_to(world.jobqueue, particlegroup);
+}
+
+void ParticleSystem::EndStep() {
+	OGJ_PROFILE_ZONE("ParticleSystem::EndStep");
+	particlegroup.wait();
 }
 
 void ParticleSystem::Draw() {
-	for (size_t i = 0; i < particles.size(); i++) {
-		if (!particles[i].isAlive) continue;
-		SpriteBatch::DrawQuad(particles[i].position, particles[i].box,
-							  ColorMix(particles[i].lifetime + particles[i].colormixoffset),
-							  -glm::radians(particles[i].rotation));
+	OGJ_PROFILE_ZONE("ParticleSystem::Draw");
+	// the chunks already built their part of the draw list, drawn in particle order
+	std::sort(chunkresults.begin(), chunkresults.end(), [](const ChunkResult& a, const ChunkResult& b) { return a.begin < b.begin; });
+	for (const ChunkResult& chunk : chunkresults) {
+		SpriteBatch::DrawQuads(drawlist.data() + chunk.begin, chunk.drawcount);
 	}
 }
 
 void ParticleSystem::Shoot(const vec2& position, const vec2& velocity, const float maxlifetime) {
-	Spawn(1, [position, velocity, maxlifetime](size_t index, Particle& p) {
+	Spawn(1, [position, velocity, maxlifetime](size_t index, Particle& p, const float* random) {
 		p.position = position;
 		p.velocity = velocity;
 		p.maxlifetime = maxlifetime;
@@ -254,15 +489,15 @@ void ParticleSystem::BoxExplode(const bounds& box, const float rotation, const f
 	vec2 startpos(box.left + (extrasize.x * 0.5f), box.bottom + (extrasize.y * 0.5f));
 	//float scalar = glm::length(velocity) * (1.0f / 60.0f);
 
-	Spawn(totalcount, [startpos, widthcount, pos, extrasize, rad, velocity, colormix](size_t index, Particle& p) {
+	Spawn(totalcount, [startpos, widthcount, pos, extrasize, rad, velocity, colormix](size_t index, Particle& p, const float* random) {
 		size_t xpos = index / widthcount;
 		size_t ypos = index % widthcount;
 		p.position = RotateAround(vec2(xpos * extrasize.x, ypos * extrasize.y) + startpos, pos, rad);
-		p.velocity = velocity * RandomRange(0.2f, 0.4f) + (p.position - pos) * RandomRange(0.5f, 5.0f);
-		p.colormixoffset = colormix + RandomRange(0.0f, 0.2f);
-		p.maxlifetime = RandomRange(2.0f, 4.0f);
+		p.velocity = velocity * random[0] + (p.position - pos) * random[1];
+		p.colormixoffset = colormix + random[2];
+		p.maxlifetime = random[3];
 		p.rotation = -glm::degrees(rad);
-		p.box = bounds::MakeFromArea(RandomRange(0.005f, 0.05f));
-	});
+		p.box = bounds::MakeFromArea(random[4]);
+	}, { vec2(0.2f, 0.4f), vec2(0.5f, 5.0f), vec2(0.0f, 0.2f), vec2(2.0f, 4.0f), vec2(0.005f, 0.05f) });
 
 }
@@ -1,7 +1,7 @@
 #ifndef BOX_PARTICLES_HPP
 #define BOX_PARTICLES_HPP
 #include "General.hpp"
-#include "Core\Timer.hpp"
+#include "Core/Timer.hpp"
 #include "SpriteBatch.hpp"
 
 struct Particle {
@@ -17,13 +17,31 @@ struct Particle {
 
 };
 
+// the arrays the particle step reads and writes, ParticleSystem keeps one of each
+struct ParticleArrays {
+	float* x;
+	float* y;
+	float* vx;
+	float* vy;
+	float* lifetime;
+	const float* maxlifetime;
+};
+
+// integrate, drag, wrap and age the particles in [begin, end), 4 at a time
+// dead particles are stepped too, their lifetime only moves further past maxlifetime
+// particles that die this step are added to expired
+void StepParticles(const ParticleArrays& particles, Timestep ts, const bounds& camera, size_t begin, size_t end, vector<uint32>& expired);
+
 struct ParticleSystem {
 
 	static void Init();
 	static void Reset();
 	static void Exit();
 
-	static void StartStep(Timestep ts);
+	// alpha is how far the frame is between this step and the next one, the draw list is built for it
+	static void StartStep(Timestep ts, const float alpha = 1.0f);
+	// rebuilds the draw list for a frame that runs no step
+	static void StartRedraw(const float alpha);
 	static void EndStep();
 	//static void Step(Timestep ts);
 	static void Draw();
@@ -1,6 +1,14 @@
 #include "Debugger.hpp"
 #include <iostream>
 #include <fstream>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #define LOG_FILE_PATH string("Logs/Log_")
 
@@ -23,83 +31,286 @@ static const string& GetLogPath() {
 	return logFilepath;
 }
 
-void Debugger::Log(const string& msg, const string& file, size_t line) {
+namespace {
 
-	// open file at the end
-	std::ofstream filestream;
-	filestream.open(GetLogPath(), std::ios::app);
+	using steady_clock = std::chrono::steady_clock;
 
-	// add msg
-	filestream << "[Log(ln:" << line << ")]: " << msg << std::endl << "\t[file: " << file << "]" << std::endl;
-	//#if _DEBUG
-	std::cout << "[Log]: " << msg << std::endl;
-	//#endif
+	enum class LogLevel { Log, Trace, Warning, Error, FatalError };
 
-	// close
-	filestream.close();
-}
+	const char* GetLevelName(LogLevel level) {
+		switch (level) {
+			case LogLevel::Log: return "Log";
+			case LogLevel::Trace: return "Trace";
+			case LogLevel::Warning: return "Warning";
+			case LogLevel::Error: return "Error";
+			case LogLevel::FatalError: return "FatalError";
+		}
+		return "";
+	}
 
-void Debugger::Trace(const string& msg, const string& file, size_t line) {
+	struct LogEntry {
+		LogLevel level = LogLevel::Log;
+		size_t line = 0;
+		string msg;
+		string file;
+	};
 
-	// open file at the end
-	std::ofstream filestream;
-	filestream.open(GetLogPath(), std::ios::app);
+	// single producer single consumer ring
+	// the owning thread pushes, the writer thread drains
+	struct LogRing {
+		static constexpr size_t capacity = 1024; // must be a power of 2
+		static constexpr size_t mask = capacity - 1;
 
-	// add msg
-	filestream << "[Trace(ln:" << line << ")]: " << msg << std::endl << "\t[file: " << file << "]" << std::endl;
-	//#if _DEBUG
-	std::cout << "[Trace]: " << msg << std::endl;
-	//#endif
+		std::array<LogEntry, capacity> entries;
+		std::atomic_size_t head = 0; // next slot to write, only changed by the owner
+		std::atomic_size_t tail = 0; // next slot to read, only changed by the writer
 
-	// close
-	filestream.close();
-}
+		// only changed by the owner, read by GetStats
+		std::atomic_size_t messages = 0;
+		std::atomic<uint64_t> nanoseconds = 0;
 
-void Debugger::Warning(const string& msg, const string& file, size_t line) {
+		size_t Pending() const {
+			return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+		}
+
+		bool TryPush(LogEntry& entry) {
+			const size_t h = head.load(std::memory_order_relaxed);
+			if (h - tail.load(std::memory_order_acquire) == capacity)
+				return false;
+			entries[h & mask] = std::move(entry);
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		template<typename Func>
+		void Drain(Func func) {
+			size_t t = tail.load(std::memory_order_relaxed);
+			const size_t h = head.load(std::memory_order_acquire);
+			for (; t != h; t++) {
+				func(entries[t & mask]);
+			}
+			tail.store(h, std::memory_order_release);
+		}
+	};
+
+	class LogWriter {
+	public:
+
+		// how long messages can sit in a ring before they are written
+		static constexpr auto flushinterval = std::chrono::milliseconds(100);
+		// a ring this full wakes the writer early
+		static constexpr size_t flushthreshold = LogRing::capacity / 2;
 
-	// open file at the end
-	std::ofstream filestream;
-	filestream.open(GetLogPath(), std::ios::app);
+		LogWriter() {
+			m_thread = std::thread([this]() { Run(); });
+		}
+
+		~LogWriter() {
+			{
+				std::lock_guard<std::mutex> _(m_lock);
+				m_running = false;
+			}
+			m_wake.notify_one();
+			m_thread.join();
+		}
+
+		void Push(LogEntry& entry) {
+			LogRing& ring = GetLocalRing();
+			while (!ring.TryPush(entry)) {
+				// full, let the writer catch up
+				Wake();
+				std::this_thread::yield();
+			}
+			if (ring.Pending() == flushthreshold)
+				Wake();
+		}
+
+		void Flush() {
+			std::unique_lock<std::mutex> lock(m_lock);
+			const size_t target = ++m_flushrequested;
+			m_shouldwake = true;
+			m_wake.notify_one();
+			m_flushed.wait(lock, [&]() { return m_flushcompleted >= target || !m_running; });
+		}
 
-	// add msg
-	filestream << "[Warning(ln:" << line << ")]: " << msg << std::endl << "\t[file: " << file << "]" << std::endl;
-	//#if _DEBUG
-	std::cout << "[Warning]: " << msg << std::endl;
-	//#endif
+		LogStats GetStats() {
+			std::lock_guard<std::mutex> _(m_lock);
+			LogStats stats;
+			stats.messages = m_retiredmessages;
+			stats.totalnanoseconds = m_retirednanoseconds;
+			for (auto& ring : m_rings) {
+				stats.messages += ring->messages.load(std::memory_order_relaxed);
+				stats.totalnanoseconds += ring->nanoseconds.load(std::memory_order_relaxed);
+			}
+			if (stats.messages > 0)
+				stats.averagenanoseconds = double(stats.totalnanoseconds) / double(stats.messages);
+			return stats;
+		}
+
+		// the ring owned by the calling thread, made on first use
+		LogRing& GetLocalRing() {
+			thread_local std::shared_ptr<LogRing> localring;
+			if (!localring) {
+				localring = std::make_shared<LogRing>();
+				std::lock_guard<std::mutex> _(m_lock);
+				m_rings.push_back(localring);
+			}
+			return *localring;
+		}
+
+	private:
+
+		std::thread m_thread;
+		std::mutex m_lock;
+		std::condition_variable m_wake;
+		std::condition_variable m_flushed;
+		std::vector<std::shared_ptr<LogRing>> m_rings;
+		bool m_running = true;
+		bool m_shouldwake = false;
+		size_t m_flushrequested = 0;
+		size_t m_flushcompleted = 0;
+		size_t m_retiredmessages = 0;
+		uint64_t m_retirednanoseconds = 0;
+
+		std::ofstream m_file;
+		string m_filebuffer;
+		string m_consolebuffer;
+
+		void Wake() {
+			{
+				std::lock_guard<std::mutex> _(m_lock);
+				m_shouldwake = true;
+			}
+			m_wake.notify_one();
+		}
+
+		void Run() {
+			m_file.open(GetLogPath(), std::ios::app);
+			std::vector<std::shared_ptr<LogRing>> rings;
+			std::unique_lock<std::mutex> lock(m_lock);
+			while (m_running) {
+				m_wake.wait_for(lock, flushinterval, [&]() { return m_shouldwake || !m_running; });
+				m_shouldwake = false;
+				const size_t target = m_flushrequested;
+				PruneRings();
+				rings = m_rings;
+				lock.unlock();
+
+				WriteAll(rings);
+
+				lock.lock();
+				m_flushcompleted = target;
+				m_flushed.notify_all();
+			}
+			rings = m_rings;
+			lock.unlock();
+
+			// anything logged while shutting down
+			WriteAll(rings);
+			m_file.close();
+		}
+
+		// drops rings whose thread has exited and that have nothing left to write
+		void PruneRings() {
+			for (size_t i = 0; i < m_rings.size();) {
+				auto& ring = m_rings[i];
+				if (ring.use_count() == 1 && ring->Pending() == 0) {
+					m_retiredmessages += ring->messages.load(std::memory_order_relaxed);
+					m_retirednanoseconds += ring->nanoseconds.load(std::memory_order_relaxed);
+					m_rings[i] = std::move(m_rings.back());
+					m_rings.pop_back();
+				}
+				else i++;
+			}
+		}
+
+		void WriteAll(const std::vector<std::shared_ptr<LogRing>>& rings) {
+			for (auto& ring : rings) {
+				ring->Drain([this](LogEntry& entry) {
+					const char* name = GetLevelName(entry.level);
+					m_filebuffer += "[";
+					m_filebuffer += name;
+					m_filebuffer += "(ln:" + std::to_string(entry.line) + ")]: ";
+					m_filebuffer += entry.msg;
+					m_filebuffer += "\n\t[file: ";
+					m_filebuffer += entry.file;
+					m_filebuffer += "]\n";
+					//#if _DEBUG
+					m_consolebuffer += "[";
+					m_consolebuffer += name;
+					m_consolebuffer += "]: ";
+					m_consolebuffer += entry.msg;
+					m_consolebuffer += "\n";
+					//#endif
+					entry.msg.clear();
+					entry.file.clear();
+				});
+			}
+			if (m_filebuffer.size() > 0) {
+				m_file.write(m_filebuffer.data(), m_filebuffer.size());
+				m_file.flush();
+				m_filebuffer.clear();
+			}
+			if (m_consolebuffer.size() > 0) {
+				std::cout.write(m_consolebuffer.data(), m_consolebuffer.size());
+				std::cout.flush();
+				m_consolebuffer.clear();
+			}
+		}
+	};
+
+	LogWriter& GetWriter() {
+		static LogWriter writer;
+		return writer;
+	}
+
+	void Write(LogLevel level, const string& msg, const string& file, size_t line) {
+		const auto start = steady_clock::now();
+
+		LogWriter& writer = GetWriter();
+		LogEntry entry;
+		entry.level = level;
+		entry.line = line;
+		entry.msg = msg;
+		entry.file = file;
+		writer.Push(entry);
+
+		// only the owning thread writes these so a plain load and store is enough
+		LogRing& ring = writer.GetLocalRing();
+		const uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - start).count();
+		ring.messages.store(ring.messages.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		ring.nanoseconds.store(ring.nanoseconds.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+	}
 
-	// close
-	filestream.close();
 }
 
-void Debugger::Error(const string& msg, const string& file, size_t line) {
+void Debugger::Log(const string& msg, const string& file, size_t line) {
+	Write(LogLevel::Log, msg, file, line);
+}
 
-	// open file at the end
-	std::ofstream filestream;
-	filestream.open(GetLogPath(), std::ios::app);
+void Debugger::Trace(const string& msg, const string& file, size_t line) {
+	Write(LogLevel::Trace, msg, file, line);
+}
 
-	// add msg
-	filestream << "[Error(ln:" << line << ")]: " << msg << std::endl << "\t[file: " << file << "]" << std::endl;
-	//#if _DEBUG
-	std::cout << "[Error]: " << msg << std::endl;
-	//#endif
+void Debugger::Warning(const string& msg, const string& file, size_t line) {
+	Write(LogLevel::Warning, msg, file, line);
+}
 
-	// close
-	filestream.close();
+void Debugger::Error(const string& msg, const string& file, size_t line) {
+	Write(LogLevel::Error, msg, file, line);
 }
 
 void Debugger::FatalError(const string& msg, const string& file, size_t line) {
+	Write(LogLevel::FatalError, msg, file, line);
 
-	// open file at the end
-	std::ofstream filestream;
-	filestream.open(GetLogPath(), std::ios::app);
-
-	// add msg
-	filestream << "[FatalError(ln:" << line << ")]: " << msg << std::endl << "\t[file: " << file << "]" << std::endl;
-	//#if _DEBUG
-	std::cout << "[FatalError]: " << msg << std::endl;
-	//#endif
+	// make sure this is on disk before whatever comes next
+	Flush();
+}
 
-	// close
-	filestream.close();
+void Debugger::Flush() {
+	GetWriter().Flush();
 }
 
+LogStats Debugger::GetStats() {
+	return GetWriter().GetStats();
+}
@@ -1,8 +1,9 @@
 #ifndef _CORE_DEBUGGER_HPP
 #define _CORE_DEBUGGER_HPP
-#include <glm\glm.hpp>
-#include <glm\gtx\string_cast.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtx/string_cast.hpp>
 #include <string>
+#include <cstdint>
 
 // disables the copy constructor and operator
 #define OGJ_NO_COPY(TYPE)				\
@@ -23,6 +24,15 @@ TYPE() = delete;						\
 
 using std::string;
 
+// totals across every thread that has logged so far
+struct LogStats {
+	size_t messages = 0;
+	uint64_t totalnanoseconds = 0; // time spent inside the log calls, not writing
+	double averagenanoseconds = 0.0;
+};
+
+// messages are queued on a per thread ring and written by a background thread
+// the log file is kept open and written in batches
 class Debugger {
 	OGJ_NON_CONSTRUCTABLE(Debugger);
 public:
@@ -33,6 +43,12 @@ public:
 	static void Error(const string& msg, const string& file, size_t line);
 	static void FatalError(const string& msg, const string& file, size_t line);
 
+	// blocks until everything logged before this call has been written
+	static void Flush();
+
+	// per call overhead of the log functions
+	static LogStats GetStats();
+
 };
 
 namespace stringable {
@@ -0,0 +1,172 @@
+#include "Profiler.hpp"
+#include "../cjs/ijob.hpp"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <typeinfo>
+#include <vector>
+
+namespace {
+
+	using steady_clock = std::chrono::steady_clock;
+
+	struct ProfileEvent {
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	// only the owning thread writes events, count is published after each one so readers never see a partial event
+	struct ThreadEvents {
+		static constexpr size_t capacity = 1 << 17;
+
+		std::unique_ptr<ProfileEvent[]> events = std::make_unique<ProfileEvent[]>(capacity);
+		std::atomic_size_t count = 0;
+		std::atomic_size_t dropped = 0;
+		size_t id = 0;
+		string name;
+
+		void Push(const char* eventname, uint64_t start, uint64_t end) {
+			const size_t i = count.load(std::memory_order_relaxed);
+			if (i == capacity) {
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			events[i] = { eventname, start, end };
+			count.store(i + 1, std::memory_order_release);
+		}
+	};
+
+	std::atomic_bool recording = false;
+	std::mutex threadslock;
+	std::vector<std::shared_ptr<ThreadEvents>> threads;
+
+	const steady_clock::time_point& GetEpoch() {
+		static const steady_clock::time_point epoch = steady_clock::now();
+		return epoch;
+	}
+
+	ThreadEvents& GetLocalEvents() {
+		thread_local std::shared_ptr<ThreadEvents> local;
+		if (!local) {
+			local = std::make_shared<ThreadEvents>();
+			std::lock_guard<std::mutex> _(threadslock);
+			local->id = threads.size();
+			local->name = "thread " + std::to_string(local->id);
+			threads.push_back(local);
+		}
+		return *local;
+	}
+
+	// times every job the workers run, named after the job type
+	class JobZones : public cjs::ijob_observer {
+	public:
+		// the name is taken here, the job may be gone by job_end
+		void job_begin(cjs::ijob* job) override {
+			zones.push_back({ job ? typeid(*job).name() : "function job", Profiler::Now() });
+		}
+
+		void job_end(cjs::ijob* job) override {
+			if (zones.empty()) return;
+			const OpenZone zone = zones.back();
+			zones.pop_back();
+			Profiler::Record(zone.name, zone.start, Profiler::Now());
+		}
+
+	private:
+		struct OpenZone {
+			const char* name;
+			uint64_t start;
+		};
+
+		// jobs can run jobs, so this is a stack
+		static thread_local std::vector<OpenZone> zones;
+	};
+
+	thread_local std::vector<JobZones::OpenZone> JobZones::zones;
+	JobZones jobzones;
+
+	void WriteEscaped(std::ofstream& file, const char* text) {
+		for (; *text; text++) {
+			if (*text == '"' || *text == '\\') file << '\\';
+			file << *text;
+		}
+	}
+
+}
+
+void Profiler::Start() {
+	GetEpoch();
+	{
+		std::lock_guard<std::mutex> _(threadslock);
+		for (auto& thread : threads) {
+			thread->count.store(0, std::memory_order_relaxed);
+			thread->dropped.store(0, std::memory_order_relaxed);
+		}
+	}
+	recording = true;
+	cjs::set_job_observer(&jobzones);
+}
+
+void Profiler::Stop() {
+	recording = false;
+	cjs::set_job_observer(nullptr);
+}
+
+bool Profiler::IsRecording() {
+	return recording.load(std::memory_order_relaxed);
+}
+
+void Profiler::SetThreadName(const string& name) {
+	ThreadEvents& local = GetLocalEvents();
+	std::lock_guard<std::mutex> _(threadslock);
+	local.name = name;
+}
+
+bool Profiler::WriteChromeTrace(const string& path) {
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		OGJ_DEBUG_ERROR("Failed to open " + path + " to write the trace");
+		return false;
+	}
+
+	std::lock_guard<std::mutex> _(threadslock);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	size_t dropped = 0;
+	for (auto& thread : threads) {
+		// thread names show up as the row labels
+		if (!first) file << ",\n";
+		first = false;
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << thread->id << ",\"args\":{\"name\":\"";
+		WriteEscaped(file, thread->name.c_str());
+		file << "\"}}";
+
+		// timestamps are in microseconds
+		const size_t count = thread->count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; i++) {
+			const ProfileEvent& e = thread->events[i];
+			file << ",\n{\"name\":\"";
+			WriteEscaped(file, e.name);
+			file << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << thread->id
+				<< ",\"ts\":" << (e.start / 1000) << "." << (e.start % 1000 / 100)
+				<< ",\"dur\":" << ((e.end - e.start) / 1000) << "." << ((e.end - e.start) % 1000 / 100) << "}";
+		}
+		dropped += thread->dropped.load(std::memory_order_relaxed);
+	}
+	file << "\n]}\n";
+
+	if (dropped > 0)
+		OGJ_DEBUG_WARNING("The profiler ran out of space and dropped " + VTOS(dropped) + " zones");
+	return true;
+}
+
+uint64_t Profiler::Now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(steady_clock::now() - GetEpoch()).count();
+}
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end) {
+	GetLocalEvents().Push(name, start, end);
+}
@@ -0,0 +1,60 @@
+#ifndef _CORE_PROFILER_HPP
+#define _CORE_PROFILER_HPP
+#include "Debugger.hpp"
+#include <cstdint>
+
+// records cpu zones into per thread buffers and writes them out as a chrome trace (chrome://tracing)
+// zones cost a flag check while not recording
+class Profiler {
+	OGJ_NON_CONSTRUCTABLE(Profiler);
+public:
+
+	// clears anything recorded before and starts recording, also times every cjs job
+	// call while no zones are open on other threads, such as between frames
+	static void Start();
+
+	// stops recording, zones that are still open are kept
+	static void Stop();
+
+	static bool IsRecording();
+
+	// names the calling thread in the trace, unnamed threads get a number
+	static void SetThreadName(const string& name);
+
+	// writes what was recorded, returns false if the file couldnt be opened
+	// call after Stop once the zones on other threads have closed
+	static bool WriteChromeTrace(const string& path);
+
+	// nanoseconds since the profiler was first used
+	static uint64_t Now();
+
+	// adds a finished zone for the calling thread, name has to outlive the profiler
+	static void Record(const char* name, uint64_t start, uint64_t end);
+
+};
+
+// times the scope it is declared in
+class ProfileZone {
+	OGJ_NO_COPY(ProfileZone);
+	OGJ_NO_MOVE(ProfileZone);
+public:
+	explicit ProfileZone(const char* name)
+		: m_name(name), m_recording(Profiler::IsRecording()), m_start(m_recording ? Profiler::Now() : 0) { }
+
+	~ProfileZone() {
+		if (m_recording) Profiler::Record(m_name, m_start, Profiler::Now());
+	}
+
+private:
+	const char* m_name;
+	bool m_recording;
+	uint64_t m_start;
+};
+
+#define OGJ_PROFILE_CONCAT_IMPL(a, b) a##b
+#define OGJ_PROFILE_CONCAT(a, b) OGJ_PROFILE_CONCAT_IMPL(a, b)
+
+#define OGJ_PROFILE_ZONE(name) \
+	::ProfileZone OGJ_PROFILE_CONCAT(_profilezone, __LINE__)(name)
+
+#endif // !_CORE_PROFILER_HPP
\ No newline at end of file
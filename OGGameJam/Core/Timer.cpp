@@ -1,7 +1,8 @@
 #include "Timer.hpp"
 #include "Debugger.hpp"
+#include <cmath>
 
-Timer::Timer() : targetFPS(0), lastDelta(0.0) {
+Timer::Timer() : targetFPS(0), lastDelta(0.0), fixedDelta(0.0), maxSubsteps(0), accumulator(0.0), substeps(0) {
 	SetTargetFPS(60);
 	lastTime = currentTime = steady_clock::now();
 }
@@ -16,6 +17,17 @@ void Timer::BeginFrame() {
 	lastDelta = (currentTime - lastTime).count();
 	// save the previous time point
 	lastTime = currentTime;
+
+	if (fixedDelta > 0.0) {
+		accumulator += lastDelta;
+		substeps = static_cast<uint32>(accumulator / fixedDelta);
+		if (substeps > maxSubsteps) {
+			// drop what couldnt be simulated, but keep how far into the next step we are
+			substeps = maxSubsteps;
+			accumulator = fmod(accumulator, fixedDelta);
+		}
+		else accumulator -= fixedDelta * substeps;
+	}
 }
 
 void Timer::EndFrame() {
@@ -51,3 +63,15 @@ float Timer::GetFPS() const {
 float Timer::GetDelta() const {
 	return static_cast<float>(lastDelta);
 }
+
+void Timer::SetFixedStep(const double delta, const uint32 maxsubsteps) {
+	fixedDelta = delta;
+	maxSubsteps = maxsubsteps;
+	accumulator = 0.0;
+	substeps = 0;
+}
+
+float Timer::GetAlpha() const {
+	if (fixedDelta <= 0.0) return 1.0f;
+	return glm::clamp(static_cast<float>(accumulator / fixedDelta), 0.0f, 1.0f);
+}
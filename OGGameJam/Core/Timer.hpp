@@ -32,6 +32,12 @@ class Timer {
 	double secondsPerFrame;
 	double lastDelta;
 
+	// fixed step, 0 when off
+	double fixedDelta;
+	uint32 maxSubsteps;
+	double accumulator;
+	uint32 substeps;
+
 public:
 
 	Timer();
@@ -55,6 +61,16 @@ public:
 	float GetFPS() const;
 	float GetDelta() const;
 
+	// runs the simulation at a fixed rate, each frame delta goes into an accumulator that is spent in whole steps
+	// at most maxsubsteps run per frame, time past that is dropped so one slow frame doesnt snowball
+	// pass 0 to turn it off
+	void SetFixedStep(const double delta, const uint32 maxsubsteps);
+	// how many fixed steps to run this frame, set by BeginFrame
+	uint32 GetSubsteps() const { return substeps; }
+	Timestep GetFixedTimestep() const { return Timestep(fixedDelta); }
+	// how far the frame is between the last fixed step and the next one, from 0 to 1
+	float GetAlpha() const;
+
 };
 
 // operators for multiplying with timesteps
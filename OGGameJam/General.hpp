@@ -1,7 +1,7 @@
 #ifndef GENERAL_HPP
 #define GENERAL_HPP
 
-#include <glm\glm.hpp>
+#include <glm/glm.hpp>
 using glm::uvec2;
 using glm::vec2;
 using glm::vec3;
@@ -9,15 +9,20 @@ using glm::vec4;
 using glm::mat4;
 
 #include <inttypes.h>
+using uint8 = uint8_t;
 using uint32 = uint32_t;
 using int32 = int32_t;
+using uint64 = uint64_t;
+
+#include <atomic>
+#include <emmintrin.h>
 
 #include <vector>
 using std::vector;
 #include <string>
 using std::string;
 
-#include "Core\Debugger.hpp"
+#include "Core/Debugger.hpp"
 
 inline vec4 ColorMix(const float mix) {
 	const static vec4 colors[] = {
@@ -43,9 +48,116 @@ inline vec4 ColorMix(const float mix) {
 	return glm::mix(colors[index], colors[(index + 1) % colors_count], mixval);
 }
 
+// xoshiro128+, small and fast, the low bits are weak so floats are made from the high bits
+struct Random {
+	Random(const uint64 seed = 0) { Seed(seed); }
+
+	// expands the seed with splitmix64 so similar seeds still give unrelated streams
+	void Seed(uint64 seed) {
+		for (size_t i = 0; i < 4; i += 2) {
+			seed += 0x9E3779B97F4A7C15ull;
+			uint64 z = seed;
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			z = z ^ (z >> 31);
+			state[i] = static_cast<uint32>(z);
+			state[i + 1] = static_cast<uint32>(z >> 32);
+		}
+	}
+
+	uint32 Next() {
+		const uint32 result = state[0] + state[3];
+		const uint32 t = state[1] << 9;
+		state[2] ^= state[0];
+		state[3] ^= state[1];
+		state[1] ^= state[2];
+		state[0] ^= state[3];
+		state[2] ^= t;
+		state[3] = (state[3] << 11) | (state[3] >> 21);
+		return result;
+	}
+
+	uint64 Next64() {
+		const uint64 high = Next();
+		return (high << 32) | Next();
+	}
+
+	// [0, 1)
+	float NextFloat() {
+		return static_cast<float>(Next() >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float Range(const float min, const float max) {
+		return NextFloat() * (max - min) + min;
+	}
+
+	// fills count values in [min, max), for filling whole arrays at once
+	// runs 4 generators side by side seeded from this one, so the values differ from calling Range count times
+	// but are still the same for the same seed
+	void Fill(float* out, const size_t count, const float min, const float max) {
+		const float scale = (max - min) * (1.0f / 16777216.0f);
+		size_t i = 0;
+		if (count >= fillsimdmin) {
+			alignas(16) uint32 lanes[4][4];
+			for (size_t lane = 0; lane < 4; lane++) {
+				const Random seeded(Next64());
+				for (size_t word = 0; word < 4; word++) {
+					lanes[word][lane] = seeded.state[word];
+				}
+			}
+			__m128i s0 = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes[0]));
+			__m128i s1 = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes[1]));
+			__m128i s2 = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes[2]));
+			__m128i s3 = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes[3]));
+			const __m128 scale4 = _mm_set1_ps(scale);
+			const __m128 min4 = _mm_set1_ps(min);
+			for (; i + 4 <= count; i += 4) {
+				// same steps as Next, one generator per lane
+				const __m128i result = _mm_add_epi32(s0, s3);
+				const __m128i t = _mm_slli_epi32(s1, 9);
+				s2 = _mm_xor_si128(s2, s0);
+				s3 = _mm_xor_si128(s3, s1);
+				s1 = _mm_xor_si128(s1, s2);
+				s0 = _mm_xor_si128(s0, s3);
+				s2 = _mm_xor_si128(s2, t);
+				s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+				// 24 bits fit a signed int, so the signed convert is exact
+				const __m128 value = _mm_cvtepi32_ps(_mm_srli_epi32(result, 8));
+				_mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(value, scale4), min4));
+			}
+		}
+		for (; i < count; i++) {
+			out[i] = static_cast<float>(Next() >> 8) * scale + min;
+		}
+	}
+
+private:
+	// below this seeding the 4 lanes costs more than it saves
+	static constexpr size_t fillsimdmin = 16;
+
+	uint32 state[4];
+};
+
+// seed new thread generators are made from, see SeedRandom
+inline std::atomic<uint64> randomseed = 1;
+inline std::atomic<uint64> randomthreads = 0;
+
+// the generator for the calling thread
+// threads are seeded in the order they first call this, so only the thread that called SeedRandom is reproducible
+// jobs that need to be reproducible should reseed it with a seed handed out by the main thread
+inline Random& GetThreadRandom() {
+	thread_local Random random(randomseed.load() + randomthreads.fetch_add(1) * 0x9E3779B97F4A7C15ull);
+	return random;
+}
+
+// reseeds the calling thread and every thread that hasnt made its generator yet
+inline void SeedRandom(const uint64 seed) {
+	randomseed = seed;
+	GetThreadRandom().Seed(seed);
+}
+
 inline float RandomRange(const float min, const float max) {
-	constexpr float invmaxrand = 1.0f / static_cast<float>(RAND_MAX);
-	return (static_cast<float>(rand()) * invmaxrand) * (max - min) + min;
+	return GetThreadRandom().Range(min, max);
 }
 
 #endif // !GENERAL_HPP
\ No newline at end of file
@@ -0,0 +1,224 @@
+// runs the simulation without a window, renderer or SDL
+// built by the Headless configuration instead of Main.cpp, SpriteBatch.cpp, Core/Window.cpp and Core/Shader.cpp
+// on linux it is built by the CMakeLists.txt next to OGGameJam.sln, which only needs glm
+// usage: OGGameJam -frames 3600 -seed 1 -fps 60 -boxes 10000 -broadphase sweep -trace Logs/Trace.json
+//        OGGameJam -ringtest
+//        OGGameJam -bench queue|park|particles|broadphase|boxes -threads 4
+#include "World.hpp"
+#include "SpriteBatch.hpp"
+#include "BoxBattle.hpp"
+#include "BoxParticles.hpp"
+#include "Core/Profiler.hpp"
+#include "Benchmarks.hpp"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#pragma region SpriteBatch
+
+// nothing is drawn in the headless build
+void SpriteBatch::Init(const VertexFormat format) { }
+void SpriteBatch::Exit() { }
+void SpriteBatch::Begin(const vec2& screensize) { }
+void SpriteBatch::Begin(const rect& region) { }
+void SpriteBatch::Begin(const mat4& transform) { }
+void SpriteBatch::End() { }
+void SpriteBatch::DrawQuad(const rect& position, const vec4& color) { }
+void SpriteBatch::DrawQuad(const bounds& position, const vec4& color) { }
+void SpriteBatch::DrawQuad(const vec2& position, const bounds& box, const vec4& color, const float rotation) { }
+void SpriteBatch::DrawQuads(const quadinstance* quads, const size_t count) { }
+void SpriteBatch::DrawVerts(const vertex& sv0, const vertex& sv1, const vertex& sv2) { }
+void SpriteBatch::DrawVerts(const vec2& offset, vertex sv0, vertex sv1, vertex sv2) { }
+bool SpriteBatch::IsDrawing() { return false; }
+void SpriteBatch::SetInstancedQuads(const bool enabled) { }
+void SpriteBatch::SetFlushBudget(const size_t verticies) { }
+
+const SpriteBatchStats& SpriteBatch::GetStats() {
+	static SpriteBatchStats stats;
+	return stats;
+}
+
+uint32 SpriteBatch::PackColor(const vec4& color) {
+	return glm::packUnorm4x8(color);
+}
+
+#pragma endregion
+
+namespace {
+
+	using steady_clock = std::chrono::steady_clock;
+
+	struct HeadlessOptions {
+		size_t frames = 3600;
+		uint32 seed = 1;
+		double fps = 60.0;
+		size_t boxes = 0; // extra small boxes scattered over the camera to load the box step
+		BroadPhase broadphase = BroadPhase::SweepAndPrune; // -broadphase none, grid or sweep
+		string trace; // chrome trace of the whole run is written here when set
+		bool ringtest = false; // checks the vertex ring instead of running the simulation
+		string bench; // runs this benchmark instead of the simulation, see RunBenchmark
+		size_t threads = 4; // the most threads a benchmark uses on either side
+	};
+
+	HeadlessOptions ParseOptions(int argc, char** argv) {
+		HeadlessOptions options;
+		for (int i = 1; i < argc; i++) {
+			// flags
+			if (strcmp(argv[i], "-ringtest") == 0) {
+				options.ringtest = true;
+				continue;
+			}
+
+			// everything else takes a value
+			if (i + 1 >= argc) break;
+			const char* option = argv[i];
+			const char* value = argv[++i];
+			if (strcmp(option, "-frames") == 0) options.frames = strtoul(value, nullptr, 10);
+			else if (strcmp(option, "-seed") == 0) options.seed = strtoul(value, nullptr, 10);
+			else if (strcmp(option, "-fps") == 0) options.fps = strtod(value, nullptr);
+			else if (strcmp(option, "-boxes") == 0) options.boxes = strtoul(value, nullptr, 10);
+			else if (strcmp(option, "-trace") == 0) options.trace = value;
+			else if (strcmp(option, "-bench") == 0) options.bench = value;
+			else if (strcmp(option, "-threads") == 0) options.threads = strtoul(value, nullptr, 10);
+			else if (strcmp(option, "-broadphase") == 0) {
+				if (strcmp(value, "none") == 0) options.broadphase = BroadPhase::BruteForce;
+				else if (strcmp(value, "grid") == 0) options.broadphase = BroadPhase::Grid;
+				else options.broadphase = BroadPhase::SweepAndPrune;
+			}
+		}
+		if (options.frames == 0) options.frames = 1;
+		if (options.fps <= 0.0) options.fps = 60.0;
+		if (options.threads == 0) options.threads = 1;
+		return options;
+	}
+
+	// step times in microseconds for one system
+	struct StepTimes {
+		const char* name;
+		vector<double> samples;
+
+		void Add(steady_clock::time_point start, steady_clock::time_point end) {
+			samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+		}
+
+		void Print() {
+			if (samples.size() == 0) return;
+			vector<double> sorted = samples;
+			std::sort(sorted.begin(), sorted.end());
+			auto percentile = [&sorted](double p) {
+				return sorted[static_cast<size_t>(p * (sorted.size() - 1))];
+			};
+			double total = 0.0;
+			for (double sample : sorted) total += sample;
+			printf("%-16s mean %9.2f  p50 %9.2f  p90 %9.2f  p99 %9.2f  max %9.2f\n", name,
+				   total / sorted.size(), percentile(0.5), percentile(0.9), percentile(0.99), sorted.back());
+		}
+	};
+
+	// returns false if there is no benchmark with that name or its checks failed
+	bool RunBenchmark(const HeadlessOptions& options) {
+		if (options.bench == "queue") return Benchmarks::Queues(options.threads);
+		else if (options.bench == "park") Benchmarks::Parking(options.threads);
+		else if (options.bench == "particles") Benchmarks::Particles();
+		else if (options.bench == "broadphase") Benchmarks::BroadPhases();
+		else if (options.bench == "boxes") Benchmarks::Boxes();
+		else {
+			printf("unknown benchmark %s, expected queue, park, particles, broadphase or boxes\n", options.bench.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// drags in a slow circle for half of every cycle and lets go for the other half
+	// the first press lands on the left box that BoxBattle::Init makes
+	void ScriptMouse(size_t frame) {
+		World& world = GetWorld();
+		constexpr size_t cycle = 180;
+		const float angle = static_cast<float>(frame) * 0.02f;
+
+		const bool washeld = world.mouse.left.isheld;
+		world.mouse.worldpos = vec2(-glm::cos(angle), glm::sin(angle)) * 5.0f;
+		world.mouse.inFocus = true;
+		world.mouse.left.isheld = (frame % cycle) < (cycle / 2);
+		world.mouse.left.waspressed = !washeld && world.mouse.left.isheld;
+		world.mouse.right.isheld = false;
+		world.mouse.right.waspressed = false;
+	}
+
+}
+
+int main(int argc, char** argv) {
+	const HeadlessOptions options = ParseOptions(argc, argv);
+	if (options.ringtest) return Benchmarks::RingTest() ? 0 : 1;
+	if (options.bench.size() > 0) return RunBenchmark(options) ? 0 : 1;
+	SeedRandom(options.seed);
+
+	World& world = GetWorld();
+	Profiler::SetThreadName("main");
+
+	// init jobs
+	std::array<cjs::worker_thread, workercount> workers;
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].attach_to(&(world.jobqueue));
+	}
+
+	BoxBattle::Init();
+	BoxBattle::SetBroadPhase(options.broadphase);
+	BoxBattle::Scatter(options.boxes, 0.01f);
+	ParticleSystem::Init();
+
+	StepTimes particlestart = { "particles start" };
+	StepTimes battle = { "battle step" };
+	StepTimes particleend = { "particles end" };
+	StepTimes frame = { "frame" };
+	particlestart.samples.reserve(options.frames);
+	battle.samples.reserve(options.frames);
+	particleend.samples.reserve(options.frames);
+	frame.samples.reserve(options.frames);
+
+	// the same order as the loop in Main.cpp, with a fixed timestep
+	const Timestep ts(1.0 / options.fps);
+	world.isRunning = true;
+	if (options.trace.size() > 0) Profiler::Start();
+	for (size_t i = 0; i < options.frames && world.isRunning; i++) {
+		const auto t0 = steady_clock::now();
+		ParticleSystem::StartStep(ts);
+		const auto t1 = steady_clock::now();
+		ScriptMouse(i);
+		BoxBattle::Step(ts);
+		const auto t2 = steady_clock::now();
+		ParticleSystem::EndStep();
+		const auto t3 = steady_clock::now();
+
+		particlestart.Add(t0, t1);
+		battle.Add(t1, t2);
+		particleend.Add(t2, t3);
+		frame.Add(t0, t3);
+	}
+
+	if (options.trace.size() > 0) {
+		Profiler::Stop();
+		Profiler::WriteChromeTrace(options.trace);
+	}
+
+	printf("%zu frames at %.1f fps, seed %u, %zu workers, %zu extra boxes (times in microseconds)\n",
+		   options.frames, options.fps, options.seed, workercount, options.boxes);
+	particlestart.Print();
+	battle.Print();
+	particleend.Print();
+	frame.Print();
+
+	const BroadPhaseStats& stats = BoxBattle::GetBroadPhaseStats();
+	printf("last frame: %u entities, %u pairs tested, %u brute force pairs, %u sweep swaps, %u reinserted\n",
+		   stats.entities, stats.pairstested, stats.bruteforcepairs, stats.swaps, stats.reinserted);
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].attach_to(nullptr);
+	}
+	ParticleSystem::Exit();
+	BoxBattle::Exit();
+	return 0;
+}
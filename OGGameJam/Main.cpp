@@ -4,11 +4,15 @@
 #include <glm\gtc\matrix_transform.hpp>
 #include "BoxBattle.hpp"
 #include "BoxParticles.hpp"
+#include "Core/Profiler.hpp"
 
 vec2 OutBorderDir(const vec2& a, const vec2& b, const vec2& pos, float len) {
 	return glm::normalize(glm::normalize(pos - a) + glm::normalize(pos - b)) * len;
 }
 
+// set by pressing P, the capture is started or written out once the frame is done
+bool toggleprofiler = false;
+
 void PollEvents() {
 	static World& world = GetWorld();
 	static SDL_Event e;
@@ -20,6 +24,9 @@ void PollEvents() {
 					BoxBattle::Reset();
 					ParticleSystem::Reset();
 				}
+				if (e.key.repeat == 0 && e.key.keysym.scancode == SDL_SCANCODE_P) {
+					toggleprofiler = true;
+				}
 				break;
 			default: break;
 		}
@@ -38,17 +45,17 @@ void PollEvents() {
 		world.mouse.inFocus = true;
 	else world.mouse.inFocus = false;
 
+	// presses stay set until a step has seen them, frames can run no step at all
 	world.mouse.left.isheld = SDL_BUTTON(SDL_BUTTON_LEFT) & state;
 	if (!washeld && world.mouse.left.isheld)	world.mouse.left.waspressed = true;
-	else										world.mouse.left.waspressed = false;
 	world.mouse.right.isheld = SDL_BUTTON(SDL_BUTTON_RIGHT) & state;
 	if (!washeld && world.mouse.right.isheld)	world.mouse.right.waspressed = true;
-	else										world.mouse.right.waspressed = false;
 }
 
 int main(int argc, char** argv) {
 
 	World& world = GetWorld();
+	Profiler::SetThreadName("main");
 
 	// init jobs
 	std::array<cjs::worker_thread, workercount> workers;
@@ -64,9 +71,11 @@ int main(int argc, char** argv) {
 
 	// set frame rate
 	world.timer.SetTargetFPS(60);
+	// the simulation runs at 60 steps a second whatever the display rate is, drawing interpolates between steps
+	world.timer.SetFixedStep(1.0 / 60.0, 4);
 
 	// init the spritebatch and boxbattle
-	SpriteBatch::Init();
+	SpriteBatch::Init(VertexFormat::Compact);
 	BoxBattle::Init();
 	ParticleSystem::Init();
 
@@ -75,13 +84,22 @@ int main(int argc, char** argv) {
 	while (world.isRunning) {
 		// timer stuff
 		world.timer.BeginFrame();
+		OGJ_PROFILE_ZONE("Frame");
 
 		// update 
-		Timestep ts(world.timer.GetDelta());
-		ParticleSystem::StartStep(ts);
+		const uint32 substeps = world.timer.GetSubsteps();
+		const Timestep ts = world.timer.GetFixedTimestep();
+		const float alpha = world.timer.GetAlpha();
 		PollEvents();
-		BoxBattle::Step(ts);
-		OGJ_DEBUG_LOG("FPS: " + VTOS(ts.GetFPS()));
+		for (uint32 i = 0; i < substeps; i++) {
+			ParticleSystem::StartStep(ts, alpha);
+			BoxBattle::Step(ts);
+			world.mouse.left.waspressed = false;
+			world.mouse.right.waspressed = false;
+		}
+		if (substeps == 0)
+			ParticleSystem::StartRedraw(alpha);
+		OGJ_DEBUG_LOG("FPS: " + VTOS(world.timer.GetFPS()));
 
 		// render
 		window.ClearScreen(vec4(0.0f, 0.0f, 0.0f, 1.0f));
@@ -89,7 +107,7 @@ int main(int argc, char** argv) {
 		SpriteBatch::Begin(transform);
 
 		// draw 
-		BoxBattle::Draw();
+		BoxBattle::Draw(alpha);
 		ParticleSystem::EndStep(); // end the step over here at the very latest
 		ParticleSystem::Draw();
 
@@ -127,6 +145,19 @@ int main(int argc, char** argv) {
 
 		SpriteBatch::End();
 		window.SwapBuffers();
+
+		// every job has finished by now so the profiler can be started or read
+		if (toggleprofiler) {
+			toggleprofiler = false;
+			if (Profiler::IsRecording()) {
+				static size_t tracecount = 0;
+				Profiler::Stop();
+				const string path = "Logs/Trace_" + VTOS(tracecount++) + ".json";
+				if (Profiler::WriteChromeTrace(path))
+					OGJ_DEBUG_LOG("Wrote profiler trace to " + path);
+			}
+			else Profiler::Start();
+		}
 		//world.timer.WaitForEndOfFrame();
 		world.timer.EndFrame();
 	}
@@ -0,0 +1,66 @@
+#include "Palette.hpp"
+#include <glm/gtc/packing.hpp>
+#include <emmintrin.h>
+
+namespace {
+
+	struct PaletteTables {
+		vec4 colors[Palette::resolution];
+		uint32 packed[Palette::resolution];
+
+		PaletteTables() {
+			for (size_t i = 0; i < Palette::resolution; i++) {
+				colors[i] = ColorMix(static_cast<float>(i) / static_cast<float>(Palette::resolution));
+				packed[i] = glm::packUnorm4x8(colors[i]);
+			}
+		}
+	};
+
+	const PaletteTables tables;
+
+	// the gradient repeats every 1.0 so only the fraction is used
+	size_t GetIndex(const float mix) {
+		const float fraction = mix - glm::floor(mix);
+		return static_cast<size_t>(fraction * static_cast<float>(Palette::resolution)) & (Palette::resolution - 1);
+	}
+
+}
+
+const vec4& Palette::Color(const float mix) {
+	return tables.colors[GetIndex(mix)];
+}
+
+uint32 Palette::Packed(const float mix) {
+	return tables.packed[GetIndex(mix)];
+}
+
+void Palette::Packed(const float* mix, uint32* out, const size_t count) {
+	const __m128 resolution4 = _mm_set1_ps(static_cast<float>(resolution));
+	const __m128i mask4 = _mm_set1_epi32(resolution - 1);
+	const __m128 one4 = _mm_set1_ps(1.0f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128 m = _mm_loadu_ps(mix + i);
+
+		// floor, truncation rounds negative values up so those need one taken off
+		__m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(m));
+		whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, m), one4));
+
+		const __m128 fraction = _mm_sub_ps(m, whole);
+		const __m128i index = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(fraction, resolution4)), mask4);
+
+		// no gather in sse2
+		alignas(16) uint32 lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), index);
+		out[i + 0] = tables.packed[lanes[0]];
+		out[i + 1] = tables.packed[lanes[1]];
+		out[i + 2] = tables.packed[lanes[2]];
+		out[i + 3] = tables.packed[lanes[3]];
+	}
+
+	// leftovers
+	for (; i < count; i++) {
+		out[i] = tables.packed[GetIndex(mix[i])];
+	}
+}
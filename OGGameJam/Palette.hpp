@@ -0,0 +1,23 @@
+#ifndef PALETTE_HPP
+#define PALETTE_HPP
+#include "General.hpp"
+
+// the ColorMix gradient baked into a table so colors are looked up instead of mixed
+// matches ColorMix to within one table step
+struct Palette {
+
+	// entries across the whole gradient, must be a power of 2
+	static constexpr size_t resolution = 1024;
+
+	// the color for *mix*
+	static const vec4& Color(const float mix);
+
+	// the color for *mix* as rgba8, same layout as glm::packUnorm4x8
+	static uint32 Packed(const float mix);
+
+	// packs the colors for *count* mix values, 4 at a time
+	static void Packed(const float* mix, uint32* out, const size_t count);
+
+};
+
+#endif // !PALETTE_HPP
\ No newline at end of file
@@ -1,31 +1,33 @@
 #ifndef REGIONS_HPP
 #define REGIONS_HPP
 #include "General.hpp"
-#include <glm\gtx\vector_angle.hpp>
+#include <glm/gtx/vector_angle.hpp>
 
 struct rect {
-	union {
-		struct { vec2 position, size; };
-		struct { float x, y, w, h; };
-	};
+	vec2 position, size;
 	rect() : position(0.0f), size(0.0f) { }
 	rect(float x_, float y_, float w_, float h_)
-		: x(x_), y(y_), w(w_), h(h_) { }
+		: position(x_, y_), size(w_, h_) { }
 };
 
 struct bounds {
-	union {
-		struct { vec2 min, max; };
-		struct { float left, bottom, right, top; };
-	};
-	bounds() : min(0.0f), max(0.0f) { }
+	float left, bottom, right, top;
+	bounds() : left(0.0f), bottom(0.0f), right(0.0f), top(0.0f) { }
 	bounds(float width, float height)
 		: left(-width * 0.5f), bottom(-height * 0.5f), right(width * 0.5f), top(height * 0.5f) { }
 	bounds(const vec2& min_, const vec2& max_)
-		: min(min_), max(max_) { }
+		: left(min_.x), bottom(min_.y), right(max_.x), top(max_.y) { }
 	bounds(float left_, float bottom_, float right_, float top_)
 		: left(left_), bottom(bottom_), right(right_), top(top_) { }
 
+	vec2 Min() const {
+		return vec2(left, bottom);
+	}
+
+	vec2 Max() const {
+		return vec2(right, top);
+	}
+
 	float Width() const {
 		return right - left;
 	}
@@ -63,7 +65,7 @@ struct bounds {
 	}
 
 	bool Contains(const vec2& p, const float rotation) {
-		const vec2 center = glm::mix(min, max, 0.5f);
+		const vec2 center = Center();
 		vec2 pos = glm::rotate(p - center, glm::radians(rotation)) + center;
 		if (pos.x < left || pos.x > right) return false;
 		if (pos.y < bottom || pos.y > top) return false;
@@ -1,7 +1,11 @@
 #include "SpriteBatch.hpp"
+#include "VertexRing.hpp"
 #include <glm\gtc\matrix_transform.hpp>
+#include <glm\gtc\packing.hpp>
 #include "Core/Shader.hpp"
+#include "Core/Profiler.hpp"
 #include <glew.h>
+#include <cstring>
 #include <glm\gtx\rotate_vector.hpp>
 #include <glm\gtc\matrix_transform.hpp>
 
@@ -34,21 +38,227 @@ void main() {
 
 )"";
 
+// instanced quads, one unit quad is stretched over each instance box then rotated and moved
+static const char* spritequadshadersource = R""(
+#type vertex
+#version 450 core
+layout (location = 0) in vec2 a_corner;
+layout (location = 1) in vec2 a_position;
+layout (location = 2) in vec4 a_box;
+layout (location = 3) in float a_rotation;
+layout (location = 4) in vec4 a_color;
+
+uniform mat4 u_transform;
+
+out vec4 v_color;
+
+void main() {
+	vec2 local = mix(a_box.xy, a_box.zw, a_corner);
+	float c = cos(a_rotation);
+	float s = sin(a_rotation);
+	vec2 world = vec2(local.x * c - local.y * s, local.x * s + local.y * c) + a_position;
+	v_color = a_color;
+	gl_Position = u_transform * vec4(world, 0.0, 1.0);
+}
+
+#type fragment
+#version 450 core
+out vec4 out_fragcolor;
+
+in vec4 v_color;
+
+void main() {
+	out_fragcolor = v_color;
+}
+
+)"";
+
 #pragma endregion
 
 namespace {
 
 	bool isDrawing = false;
-	vector<vertex> verticies;
-	uint32 VBO = -1, VAO = -1;
+	vector<uint8> verticies; // stored in the gpu format, vertexsize bytes each
+	uint32 VBO = -1, VAO = -1, IBO = -1;
 	uint32 bufferSize = 0;
 	uint32 shader = -1;
 	uint32 transformLoc = -1;
 
+	// flush once this many verticies are waiting so the gpu can start on them while the rest are built
+	size_t flushbudget = 65536;
+	SpriteBatchStats stats;
+
+	// the layout verticies are stored in, the api always takes full verticies
+	struct compactvertex {
+		vec2 position;
+		uint32 color;
+	};
+	VertexFormat vertexformat = VertexFormat::Full;
+	size_t vertexsize = sizeof(vertex);
+
+	// converts v into the current vertex format at dest
+	void WriteVert(uint8* dest, const vertex& v) {
+		if (vertexformat == VertexFormat::Compact) {
+			compactvertex* cv = reinterpret_cast<compactvertex*>(dest);
+			cv->position = v.position;
+			cv->color = SpriteBatch::PackColor(v.color);
+		}
+		else memcpy(dest, &v, sizeof(vertex));
+	}
+
+	// persistent mapped streaming, used when ARB_buffer_storage is available
+	// the buffer is split into regions, each one is fenced after it is drawn
+	// and waited on before it is written again
+	constexpr size_t streamregioncount = 3;
+	constexpr size_t streamregionverts = 3 * 65536;
+
+	// everything in the vertex stream is a quad of 4 verticies drawn through a static index buffer
+	// triangles repeat their last vertex so the second half of the quad is degenerate
+	constexpr size_t maxbatchquads = streamregionverts / 4;
+	bool isStreaming = false;
+	uint8* mapped = nullptr;
+
+	// the gl side of the vertex stream, the region bookkeeping lives in VertexStream
+	struct GlStream {
+		using fence_t = GLsync;
+
+		void Draw(size_t first, size_t count) {
+			stats.flushes++;
+			stats.bytesuploaded += count * vertexsize;
+			glDrawElementsBaseVertex(GL_TRIANGLES, (count / 4) * 6, GL_UNSIGNED_INT, nullptr, first);
+		}
+
+		GLsync Fence() {
+			return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		void Wait(GLsync fence) {
+			GLenum result = glClientWaitSync(fence, 0, 0);
+			while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED && result != GL_WAIT_FAILED) {
+				result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			}
+		}
+
+		void Delete(GLsync fence) {
+			glDeleteSync(fence);
+		}
+	};
+	VertexStream<GlStream> stream;
+
+	void FlushVerts();
+
+	size_t PendingVerts() {
+		return isStreaming ? stream.Ring().PendingCount() : verticies.size() / vertexsize;
+	}
+
+	// returns where to write count verticies
+	uint8* AllocateVerts(size_t count) {
+		stats.verticies += count;
+		if (isStreaming) {
+			return mapped + stream.Reserve(count, flushbudget) * vertexsize;
+		}
+		if (PendingVerts() + count > flushbudget) FlushVerts();
+		const size_t first = verticies.size();
+		verticies.resize(first + count * vertexsize);
+		return verticies.data() + first;
+	}
+
+	// uploads and draws the vertex vector, only used when not streaming
+	void FlushVerts() {
+		if (isStreaming) {
+			stream.Flush();
+			return;
+		}
+
+		if (verticies.size() == 0)
+			return;
+		const uint32 bytes = verticies.size();
+
+		// grow the buffer to fit, then orphan it so this upload doesnt wait on the last draw
+		if (bufferSize < bytes) {
+			bufferSize = glm::max(bytes, bufferSize * 2);
+		}
+		glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+
+		// update the vertex data
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, verticies.data());
+		stats.flushes++;
+		stats.bytesuploaded += bytes;
+
+		// draw, the flush budget keeps this within the index buffer
+		glDrawElements(GL_TRIANGLES, (bytes / vertexsize / 4) * 6, GL_UNSIGNED_INT, nullptr);
+
+		// clear out vector
+		verticies.clear();
+	}
+
+	bool HasPendingVerts() {
+		return PendingVerts() != 0;
+	}
+
+	// instanced quads, 32 bytes per quad instead of 4 verticies
+	// quads and triangles are kept in submission order by flushing one before the other is added
+	bool useInstancing = true;
+	vector<quadinstance> instances;
+	uint32 quadVAO = -1, unitVBO = -1, instanceVBO = -1;
+	uint32 instanceBufferSize = 0;
+	uint32 quadshader = -1;
+	uint32 quadTransformLoc = -1;
+
+	void FlushQuads() {
+		if (instances.size() == 0)
+			return;
+		const uint32 bytes = (sizeof(quadinstance) * instances.size());
+
+		glUseProgram(quadshader);
+		glBindVertexArray(quadVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+		// grow or orphan the instance buffer so we never wait on the last draw
+		if (instanceBufferSize < bytes) {
+			instanceBufferSize = glm::max(bytes, instanceBufferSize * 2);
+		}
+		glBufferData(GL_ARRAY_BUFFER, instanceBufferSize, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+		stats.flushes++;
+		stats.bytesuploaded += bytes;
+
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instances.size());
+		instances.clear();
+
+		// back to the triangle pipeline
+		glUseProgram(shader);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	}
+
+	void PushQuad(const vec2& position, const vec2& min, const vec2& max, const float rad, const vec4& color) {
+		if (HasPendingVerts()) FlushVerts();
+		if ((instances.size() + 1) * 4 > flushbudget) FlushQuads();
+		stats.quads++;
+		quadinstance& inst = instances.emplace_back();
+		inst.position = position;
+		inst.box = vec4(min.x, min.y, max.x, max.y);
+		inst.rotation = rad;
+		inst.color = SpriteBatch::PackColor(color);
+	}
+
+	// bottom left, top left, top right, bottom right
+	void WriteQuad(const vertex& v0, const vertex& v1, const vertex& v2, const vertex& v3) {
+		if (instances.size() != 0) FlushQuads();
+		uint8* verts = AllocateVerts(4);
+		WriteVert(verts, v0);
+		WriteVert(verts + vertexsize, v1);
+		WriteVert(verts + vertexsize * 2, v2);
+		WriteVert(verts + vertexsize * 3, v3);
+	}
+
 }
 
-void SpriteBatch::Init() {
-	verticies.reserve(100);
+void SpriteBatch::Init(const VertexFormat format) {
+	vertexformat = format;
+	vertexsize = (format == VertexFormat::Compact) ? sizeof(compactvertex) : sizeof(vertex);
+	verticies.reserve(100 * vertexsize);
 
 	// load shader
 	shader = LoadShaderSource(spriteshadersource);
@@ -61,17 +271,97 @@ void SpriteBatch::Init() {
 	// create our VBO
 	glGenBuffers(1, &VBO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+	isStreaming = GLEW_ARB_buffer_storage;
+	if (isStreaming) {
+		stream.Init(streamregionverts, streamregioncount);
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		const GLsizeiptr bytes = vertexsize * stream.Ring().Capacity();
+		glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+		mapped = static_cast<uint8*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags));
+		if (!mapped) {
+			OGJ_DEBUG_WARNING("Failed to map the sprite batch buffer, falling back to glBufferSubData");
+			isStreaming = false;
+			glDeleteBuffers(1, &VBO);
+			glGenBuffers(1, &VBO);
+			glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		}
+	}
+	if (!isStreaming) {
+		glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+	}
 
 	// set the attributes
 
-	// set the position to location 0
+	// the quad indices, this binding is part of the VAO
+	vector<uint32> indices(maxbatchquads * 6);
+	for (size_t i = 0; i < maxbatchquads; i++) {
+		const uint32 base = static_cast<uint32>(i * 4);
+		indices[i * 6 + 0] = base + 0;
+		indices[i * 6 + 1] = base + 1;
+		indices[i * 6 + 2] = base + 2;
+		indices[i * 6 + 3] = base + 0;
+		indices[i * 6 + 4] = base + 2;
+		indices[i * 6 + 5] = base + 3;
+	}
+	glGenBuffers(1, &IBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32) * indices.size(), indices.data(), GL_STATIC_DRAW);
+
+	// the shader takes a vec4 color either way, rgba8 is normalized on the way in
+	if (vertexformat == VertexFormat::Compact) {
+		// set the position to location 0
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(compactvertex), (GLvoid*)offsetof(compactvertex, position));
+
+		// set the color to location 1
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(compactvertex), (GLvoid*)offsetof(compactvertex, color));
+	}
+	else {
+		// set the position to location 0
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid*)offsetof(vertex, position));
+
+		// set the color to location 1
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid*)offsetof(vertex, color));
+	}
+
+	// create the instanced quad pipeline
+	quadshader = LoadShaderSource(spritequadshadersource);
+	quadTransformLoc = glGetUniformLocation(quadshader, "u_transform");
+	instances.reserve(100);
+
+	glGenVertexArrays(1, &quadVAO);
+	glBindVertexArray(quadVAO);
+
+	// the unit quad, same winding as the cpu path
+	const vec2 corners[6] = {
+		vec2(0.0f, 0.0f), vec2(0.0f, 1.0f), vec2(1.0f, 1.0f),
+		vec2(0.0f, 0.0f), vec2(1.0f, 1.0f), vec2(1.0f, 0.0f),
+	};
+	glGenBuffers(1, &unitVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, unitVBO);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid*)offsetof(vertex, position));
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vec2), (GLvoid*)0);
 
-	// set the color to location 1
+	// the per instance data
+	glGenBuffers(1, &instanceVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
 	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertex), (GLvoid*)offsetof(vertex, color));
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(quadinstance), (GLvoid*)offsetof(quadinstance, position));
+	glVertexAttribDivisor(1, 1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(quadinstance), (GLvoid*)offsetof(quadinstance, box));
+	glVertexAttribDivisor(2, 1);
+	glEnableVertexAttribArray(3);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(quadinstance), (GLvoid*)offsetof(quadinstance, rotation));
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(quadinstance), (GLvoid*)offsetof(quadinstance, color));
+	glVertexAttribDivisor(4, 1);
 
 	// unbind
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -79,7 +369,22 @@ void SpriteBatch::Init() {
 }
 
 void SpriteBatch::Exit() {
+	if (isStreaming) {
+		stream.WaitForAll();
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		mapped = nullptr;
+		isStreaming = false;
+	}
+	glDeleteBuffers(1, &VBO);
+	glDeleteBuffers(1, &IBO);
+	glDeleteVertexArrays(1, &VAO);
 	glDeleteProgram(shader);
+	glDeleteBuffers(1, &unitVBO);
+	glDeleteBuffers(1, &instanceVBO);
+	glDeleteVertexArrays(1, &quadVAO);
+	glDeleteProgram(quadshader);
 }
 
 void SpriteBatch::Begin(const vec2& screensize) {
@@ -88,13 +393,19 @@ void SpriteBatch::Begin(const vec2& screensize) {
 }
 
 void SpriteBatch::Begin(const rect& region) {
-	mat4 transform = glm::ortho(region.x, region.x + region.w, region.y + region.h, region.y);
+	const vec2 max = region.position + region.size;
+	mat4 transform = glm::ortho(region.position.x, max.x, max.y, region.position.y);
 	Begin(transform);
 }
 
 void SpriteBatch::Begin(const mat4& transform) {
 	if (isDrawing) End();
 	isDrawing = true;
+	stats = SpriteBatchStats();
+
+	// set the instanced quad transform
+	glUseProgram(quadshader);
+	glUniformMatrix4fv(quadTransformLoc, 1, GL_FALSE, &(transform[0].x));
 
 	// use shader
 	glUseProgram(shader);
@@ -109,31 +420,23 @@ void SpriteBatch::Begin(const mat4& transform) {
 }
 
 void SpriteBatch::End() {
-	if (verticies.size() == 0)
-		return;
-	const uint32 bytes = (sizeof(vertex) * verticies.size());
-
-	// resize the buffer if needed
-	if (bufferSize < bytes) {
-		if (bufferSize == 0) bufferSize = bytes;
-		else bufferSize *= 2;
-		glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
-	}
+	OGJ_PROFILE_ZONE("SpriteBatch::End");
+	// only one of these has anything pending
+	FlushVerts();
+	FlushQuads();
 
-	// update the vertex data
-	glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, verticies.data());
-
-	// draw
-	glDrawArrays(GL_TRIANGLES, 0, verticies.size());
-
-	// clear out vector
-	verticies.clear();
+	// give the gpu this region while the next frame fills the next one
+	if (isStreaming) stream.EndFrame();
 
 	// we are no longer drawing
 	isDrawing = false;
 }
 
 void SpriteBatch::DrawQuad(const rect& position, const vec4& color) {
+	if (useInstancing) {
+		PushQuad(vec2(0.0f), position.position, position.position + position.size, 0.0f, color);
+		return;
+	}
 
 	const vec2 min = position.position;
 	const vec2 max = position.position + position.size;
@@ -151,42 +454,48 @@ void SpriteBatch::DrawQuad(const rect& position, const vec4& color) {
 		= verts[2].color = verts[3].color = color;
 
 	// submit our verticies to be drawn;
-	DrawVerts(verts[0], verts[1], verts[2]);
-	DrawVerts(verts[0], verts[2], verts[3]);
+	WriteQuad(verts[0], verts[1], verts[2], verts[3]);
 
 	// finish
 }
 
 void SpriteBatch::DrawQuad(const bounds& position, const vec4& color) {
+	if (useInstancing) {
+		PushQuad(vec2(0.0f), position.Min(), position.Max(), 0.0f, color);
+		return;
+	}
 
 	// create verticies
 	vertex verts[4];
 
-	/* bottom left  */ verts[0].position = position.min;
-	/* top left     */ verts[1].position = vec2(position.min.x, position.max.y);
-	/* top right    */ verts[2].position = position.max;
-	/* bottom right */ verts[3].position = vec2(position.max.x, position.min.y);
+	/* bottom left  */ verts[0].position = vec2(position.left, position.bottom);
+	/* top left     */ verts[1].position = vec2(position.left, position.top);
+	/* top right    */ verts[2].position = vec2(position.right, position.top);
+	/* bottom right */ verts[3].position = vec2(position.right, position.bottom);
 
 	// set color
 	verts[0].color = verts[1].color
 		= verts[2].color = verts[3].color = color;
 
 	// submit our verticies to be drawn;
-	DrawVerts(verts[0], verts[1], verts[2]);
-	DrawVerts(verts[0], verts[2], verts[3]);
+	WriteQuad(verts[0], verts[1], verts[2], verts[3]);
 
 	// finish
 }
 
 void SpriteBatch::DrawQuad(const vec2& position, const bounds& box, const vec4& color, const float rotation) {
+	if (useInstancing) {
+		PushQuad(position, box.Min(), box.Max(), -glm::radians(rotation), color);
+		return;
+	}
 
 	// create verticies
 	vertex verts[4];
 
-	/* bottom left  */ verts[0].position = box.min;
-	/* top left     */ verts[1].position = vec2(box.min.x, box.max.y);
-	/* top right    */ verts[2].position = box.max;
-	/* bottom right */ verts[3].position = vec2(box.max.x, box.min.y);
+	/* bottom left  */ verts[0].position = vec2(box.left, box.bottom);
+	/* top left     */ verts[1].position = vec2(box.left, box.top);
+	/* top right    */ verts[2].position = vec2(box.right, box.top);
+	/* bottom right */ verts[3].position = vec2(box.right, box.bottom);
 
 	const float rad = -glm::radians(rotation);
 	for (size_t i = 0; i < 4; i++) {
@@ -198,18 +507,50 @@ void SpriteBatch::DrawQuad(const vec2& position, const bounds& box, const vec4&
 		= verts[2].color = verts[3].color = color;
 
 	// submit our verticies to be drawn;
-	DrawVerts(verts[0], verts[1], verts[2]);
-	DrawVerts(verts[0], verts[2], verts[3]);
+	WriteQuad(verts[0], verts[1], verts[2], verts[3]);
 
 	// finish
 }
 
+void SpriteBatch::DrawQuads(const quadinstance* quads, const size_t count) {
+	if (count == 0) return;
+	if (useInstancing) {
+		if (HasPendingVerts()) FlushVerts();
+		stats.quads += count;
+
+		// split so no single upload goes over the flush budget
+		const size_t budgetquads = flushbudget / 4;
+		for (size_t first = 0; first < count;) {
+			if (instances.size() >= budgetquads) FlushQuads();
+			const size_t take = glm::min(count - first, budgetquads - instances.size());
+			instances.insert(instances.end(), quads + first, quads + first + take);
+			first += take;
+		}
+		return;
+	}
+
+	// expand into triangles the same way DrawQuad does
+	for (size_t i = 0; i < count; i++) {
+		const quadinstance& quad = quads[i];
+		vertex verts[4];
+
+		/* bottom left  */ verts[0].position = vec2(quad.box.x, quad.box.y);
+		/* top left     */ verts[1].position = vec2(quad.box.x, quad.box.w);
+		/* top right    */ verts[2].position = vec2(quad.box.z, quad.box.w);
+		/* bottom right */ verts[3].position = vec2(quad.box.z, quad.box.y);
+
+		const vec4 color = glm::unpackUnorm4x8(quad.color);
+		for (size_t j = 0; j < 4; j++) {
+			verts[j].position = glm::rotate(verts[j].position, quad.rotation) + quad.position;
+			verts[j].color = color;
+		}
+
+		WriteQuad(verts[0], verts[1], verts[2], verts[3]);
+	}
+}
+
 void SpriteBatch::DrawVerts(const vertex& sv0, const vertex& sv1, const vertex& sv2) {
-	if (verticies.capacity() - 3 <= verticies.size())
-		verticies.reserve(verticies.capacity() * 2);
-	verticies.push_back(sv0);
-	verticies.push_back(sv1);
-	verticies.push_back(sv2);
+	WriteQuad(sv0, sv1, sv2, sv2);
 }
 
 void SpriteBatch::DrawVerts(const vec2& offset, vertex sv0, vertex sv1, vertex sv2) { 
@@ -222,3 +563,25 @@ void SpriteBatch::DrawVerts(const vec2& offset, vertex sv0, vertex sv1, vertex s
 bool SpriteBatch::IsDrawing() {
 	return isDrawing;
 }
+
+void SpriteBatch::SetFlushBudget(const size_t verticies) {
+	// whole quads, and no more than the index buffer covers
+	const size_t budget = glm::clamp<size_t>(verticies & ~size_t(3), 4, maxbatchquads * 4);
+	if (isDrawing && PendingVerts() > budget) FlushVerts();
+	if (isDrawing && instances.size() * 4 > budget) FlushQuads();
+	flushbudget = budget;
+}
+
+const SpriteBatchStats& SpriteBatch::GetStats() {
+	return stats;
+}
+
+void SpriteBatch::SetInstancedQuads(const bool enabled) {
+	if (useInstancing == enabled) return;
+	if (isDrawing) FlushQuads();
+	useInstancing = enabled;
+}
+
+uint32 SpriteBatch::PackColor(const vec4& color) {
+	return glm::packUnorm4x8(color);
+}
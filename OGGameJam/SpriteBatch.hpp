@@ -8,9 +8,31 @@ struct vertex {
 	vec4 color;
 };
 
+// a single quad for the instanced path, the box is relative to position and rotated around it
+struct quadinstance {
+	vec2 position;
+	vec4 box; // min.xy, max.xy
+	float rotation; // radians
+	uint32 color; // rgba8, see SpriteBatch::PackColor
+};
+
+// how SpriteBatch stores verticies on the gpu
+enum class VertexFormat {
+	Full,		// vec2 position, vec4 color, 24 bytes
+	Compact,	// vec2 position, rgba8 color, 12 bytes
+};
+
+// counted since the last Begin
+struct SpriteBatchStats {
+	uint32 verticies = 0;		// written to the vertex stream
+	uint32 quads = 0;			// drawn as instances
+	uint32 flushes = 0;			// draw calls issued
+	size_t bytesuploaded = 0;	// vertex and instance data handed to the gpu
+};
+
 struct SpriteBatch {
 
-	static void Init();
+	static void Init(const VertexFormat format = VertexFormat::Full);
 	static void Exit();
 
 	// begin drawing using an orthographic view based on *screensize*
@@ -34,6 +56,9 @@ struct SpriteBatch {
 	// draws a quad using the bounds, color and the given rotation
 	static void DrawQuad(const vec2& position, const bounds& box, const vec4& color, const float rotation);
 
+	// draws count prebuilt quads, in order
+	static void DrawQuads(const quadinstance* quads, const size_t count);
+
 	// draws a triangle to the screen using the three given verticies
 	static void DrawVerts(const vertex& sv0, const vertex& sv1, const vertex& sv2);
 
@@ -43,6 +68,18 @@ struct SpriteBatch {
 	// checks if this is in a draw state
 	static bool IsDrawing();
 
+	// draw quads as instances of a single unit quad rather than as triangles (on by default)
+	static void SetInstancedQuads(const bool enabled);
+
+	// flush whenever this many verticies (or a quarter as many instanced quads) are waiting
+	// smaller budgets let the gpu start sooner, clamped to what one draw can index
+	static void SetFlushBudget(const size_t verticies);
+
+	static const SpriteBatchStats& GetStats();
+
+	// packs a color into the rgba8 format used by quadinstance
+	static uint32 PackColor(const vec4& color);
+
 };
 
 #endif // !SPRITEBATCH_HPP
\ No newline at end of file
@@ -0,0 +1,131 @@
+#ifndef VERTEX_RING_HPP
+#define VERTEX_RING_HPP
+#include "General.hpp"
+
+// bookkeeping for a vertex buffer split into regioncount regions that are filled one after another
+// has no gl calls so it can be checked without a gpu, the owner waits on and fences each region
+struct VertexRing {
+
+	void Init(size_t regioncapacity_, size_t regioncount_) {
+		regioncapacity = regioncapacity_;
+		regioncount = regioncount_;
+		region = 0;
+		cursor = flushed = 0;
+	}
+
+	// total number of vertices in the buffer
+	size_t Capacity() const { return regioncapacity * regioncount; }
+
+	// the region being written to
+	size_t Region() const { return region; }
+
+	// index of the first vertex in the current region
+	size_t Base() const { return region * regioncapacity; }
+
+	// checks if count more vertices fit in the current region
+	bool Fits(size_t count) const { return cursor + count <= regioncapacity; }
+
+	// reserves count vertices in the current region and returns the index of the first
+	// check Fits() first
+	size_t Reserve(size_t count) {
+		const size_t first = Base() + cursor;
+		cursor += count;
+		return first;
+	}
+
+	// vertices written since the last flush
+	size_t PendingFirst() const { return Base() + flushed; }
+	size_t PendingCount() const { return cursor - flushed; }
+	void MarkFlushed() { flushed = cursor; }
+
+	// moves to the next region, wrapping around. returns the new region
+	size_t Advance() {
+		region = (region + 1) % regioncount;
+		cursor = flushed = 0;
+		return region;
+	}
+
+private:
+	size_t regioncapacity = 0;
+	size_t regioncount = 0;
+	size_t region = 0;
+	size_t cursor = 0;
+	size_t flushed = 0;
+};
+
+// streams verticies through a VertexRing, drawing each region as it fills and fencing it once drawn
+// a region is waited on before it is written again, so nothing the gpu may still read is overwritten
+// Gpu makes the calls, SpriteBatch passes gl and the headless ring test a fake that reads draws late:
+//   using fence_t = ...;						// value initialized means no fence
+//   void Draw(size_t first, size_t count);	// draws the verticies [first, first + count)
+//   fence_t Fence();							// fences every draw so far
+//   void Wait(fence_t fence);					// blocks until the gpu has passed fence
+//   void Delete(fence_t fence);
+template<typename Gpu>
+struct VertexStream {
+	using fence_t = typename Gpu::fence_t;
+
+	Gpu gpu;
+
+	void Init(size_t regioncapacity, size_t regioncount) {
+		ring.Init(regioncapacity, regioncount);
+		fences.assign(regioncount, fence_t());
+	}
+
+	const VertexRing& Ring() const { return ring; }
+
+	// checks if the gpu may still be reading region
+	bool IsFenced(size_t region) const { return fences[region] != fence_t(); }
+
+	// reserves count verticies and returns the index of the first
+	// draws what is pending first if that would go over flushbudget, and moves to the next region if count doesnt fit
+	size_t Reserve(size_t count, size_t flushbudget) {
+		if (ring.PendingCount() + count > flushbudget) Flush();
+		if (!ring.Fits(count)) {
+			Flush();
+			NextRegion();
+		}
+		return ring.Reserve(count);
+	}
+
+	// draws everything written to the current region since the last flush
+	void Flush() {
+		if (ring.PendingCount() == 0) return;
+		gpu.Draw(ring.PendingFirst(), ring.PendingCount());
+		ring.MarkFlushed();
+	}
+
+	// fences the current region and moves on to the next one, waiting for the gpu to finish with it
+	void NextRegion() {
+		fence_t& fence = fences[ring.Region()];
+		if (fence != fence_t()) gpu.Delete(fence);
+		fence = gpu.Fence();
+		WaitForRegion(ring.Advance());
+	}
+
+	// draws what is left and gives the gpu the region while the next frame fills the next one
+	void EndFrame() {
+		Flush();
+		NextRegion();
+	}
+
+	void WaitForRegion(size_t region) {
+		fence_t& fence = fences[region];
+		if (fence == fence_t()) return;
+		gpu.Wait(fence);
+		gpu.Delete(fence);
+		fence = fence_t();
+	}
+
+	void WaitForAll() {
+		for (size_t i = 0; i < fences.size(); i++) {
+			WaitForRegion(i);
+		}
+	}
+
+private:
+	VertexRing ring;
+	vector<fence_t> fences;
+};
+
+#endif // !VERTEX_RING_HPP
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include "Core/Window.hpp"
 #include "Core/Timer.hpp"
 #include "Regions.hpp"
-#include "cjs\cjs.hpp"
+#include "cjs/cjs.hpp"
 
 constexpr float camsize = 10.0f;
 constexpr float camheight = 2.0f;
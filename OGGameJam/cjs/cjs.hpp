@@ -3,4 +3,7 @@
 #include "ijob.hpp"
 #include "fence.hpp"
 #include "worker_thread.hpp"
-#include "work_queue.hpp"
\ No newline at end of file
+#include "work_queue.hpp"
+#include "ring_queue.hpp"
+#include "job_graph.hpp"
+#include "parallel_for.hpp"
\ No newline at end of file
@@ -5,6 +5,8 @@
 #include <assert.h>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <condition_variable>
 #include <vector>
 
 #define CJS_NO_COPY(Type)				\
@@ -27,6 +29,8 @@ namespace cjs {
 	using atomic_bool = std::atomic_bool;
 	using mutex_guard = std::lock_guard<std::mutex>;
 	using thread = std::thread;
+	using condition_variable = std::condition_variable;
+	using unique_lock = std::unique_lock<std::mutex>;
 
 }
 
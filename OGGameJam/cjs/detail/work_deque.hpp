@@ -0,0 +1,69 @@
+#ifndef CJS_DETAIL_WORK_DEQUE_HPP
+#define CJS_DETAIL_WORK_DEQUE_HPP
+#include "../common.hpp"
+#include "work.hpp"
+#include <atomic>
+
+namespace cjs {
+
+	class worker_thread;
+
+	namespace detail {
+
+		// fixed size chase-lev deque of jobs and functions (never fences)
+		// only the owning worker may push and pop, any thread may steal
+		class work_deque final {
+			CJS_NO_COPY(work_deque);
+			CJS_NO_MOVE(work_deque);
+		public:
+
+			static constexpr size_t capacity = 1024;
+			static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+			enum steal_result : uint8_t {
+				steal_success,
+				steal_empty,
+				steal_abort // lost a race with another thread, worth retrying
+			};
+
+			work_deque();
+
+			// owner only, adds work to the bottom. returns false if the deque is full
+			bool push(const work& w);
+
+			// owner only, takes the most recently pushed work
+			bool pop(work& w);
+
+			// takes the oldest work
+			steal_result steal(work& w);
+
+			// approximate when called from a non owning thread
+			size_t size() const;
+
+			// the worker that may push and pop, nullptr when no worker owns it
+			std::atomic<worker_thread*> owner;
+
+		private:
+
+			// each field is atomic so a thief racing the owner reads stale values instead of tearing
+			// the stale values are thrown away when the thief fails the cas on m_top
+			struct slot {
+				std::atomic<ijob*> object;
+				std::atomic<void(*)(void*)> func;
+				std::atomic<void*> func_val;
+			};
+
+			alignas(64) std::atomic<int64_t> m_top;
+			alignas(64) std::atomic<int64_t> m_bottom;
+			alignas(64) slot m_slots[capacity];
+
+			void write_slot(int64_t index, const work& w);
+			work read_slot(int64_t index) const;
+		};
+
+	}
+}
+
+#include "work_deque.inl"
+
+#endif // !CJS_DETAIL_WORK_DEQUE_HPP
\ No newline at end of file
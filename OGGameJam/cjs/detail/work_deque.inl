@@ -0,0 +1,86 @@
+
+namespace cjs {
+	namespace detail {
+
+		inline work_deque::work_deque()
+			: owner(nullptr), m_top(0), m_bottom(0) {
+			for (size_t i = 0; i < capacity; i++) {
+				m_slots[i].object = nullptr;
+				m_slots[i].func = nullptr;
+				m_slots[i].func_val = nullptr;
+			}
+		}
+
+		inline bool work_deque::push(const work& w) {
+			CJS_ASSERT(w.type == work::type_object || w.type == work::type_func, "only jobs and functions can go in a deque");
+			const int64_t b = m_bottom.load(std::memory_order_relaxed);
+			const int64_t t = m_top.load(std::memory_order_acquire);
+			if (b - t >= static_cast<int64_t>(capacity)) return false;
+
+			write_slot(b, w);
+			std::atomic_thread_fence(std::memory_order_release);
+			m_bottom.store(b + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		inline bool work_deque::pop(work& w) {
+			const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+			m_bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = m_top.load(std::memory_order_relaxed);
+
+			// empty, undo
+			if (t > b) {
+				m_bottom.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+
+			w = read_slot(b);
+			if (t == b) {
+				// last item, race the thieves for it
+				const bool won = m_top.compare_exchange_strong(t, t + 1,
+															   std::memory_order_seq_cst, std::memory_order_relaxed);
+				m_bottom.store(b + 1, std::memory_order_relaxed);
+				return won;
+			}
+			return true;
+		}
+
+		inline work_deque::steal_result work_deque::steal(work& w) {
+			int64_t t = m_top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = m_bottom.load(std::memory_order_acquire);
+			if (t >= b) return steal_empty;
+
+			w = read_slot(t);
+			if (!m_top.compare_exchange_strong(t, t + 1,
+											   std::memory_order_seq_cst, std::memory_order_relaxed))
+				return steal_abort;
+			return steal_success;
+		}
+
+		inline size_t work_deque::size() const {
+			const int64_t b = m_bottom.load(std::memory_order_relaxed);
+			const int64_t t = m_top.load(std::memory_order_relaxed);
+			return b > t ? static_cast<size_t>(b - t) : 0;
+		}
+
+		inline void work_deque::write_slot(int64_t index, const work& w) {
+			slot& s = m_slots[index & (capacity - 1)];
+			s.object.store(w.object, std::memory_order_relaxed);
+			s.func.store(w.func, std::memory_order_relaxed);
+			s.func_val.store(w.func_val, std::memory_order_relaxed);
+		}
+
+		inline work work_deque::read_slot(int64_t index) const {
+			const slot& s = m_slots[index & (capacity - 1)];
+			work w;
+			w.object = s.object.load(std::memory_order_relaxed);
+			w.func = s.func.load(std::memory_order_relaxed);
+			w.func_val = s.func_val.load(std::memory_order_relaxed);
+			w.type = w.object ? work::type_object : work::type_func;
+			return w;
+		}
+
+	}
+}
\ No newline at end of file
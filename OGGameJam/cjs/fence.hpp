@@ -1,12 +1,13 @@
 #ifndef CJS_FENCE_HPP
 #define CJS_FENCE_HPP
 #include <atomic>
+#include "common.hpp"
 
 namespace cjs {
 
 	class ifence {
 	public:
-		virtual ~ifence() = 0 { }
+		virtual ~ifence() = 0;
 		virtual void _submit() = 0;
 		virtual void _join() = 0;
 		virtual void _mark_done() = 0;
@@ -43,16 +44,40 @@ namespace cjs {
 
 	// stops the threads but may not wake them immediately
 	// saves performance by completely stopping the thread until its next needed
-	//class slow_fence : public ifence {
-	//public:
-	//	
-	//	slow_fence();
-	//	~slow_fence() final;
-	//
-	//private:
-	//	void _join() override;
-	//	void _mark_done() override;
-	//};
+	// spins for a short while first since most fences are released quickly
+	class slow_fence : public ifence {
+	public:
+
+		slow_fence(size_t spincount = 1000);
+		~slow_fence() final;
+
+		// waits for all threads to be blocked by this fence
+		void await();
+
+		// lets all threads resume running
+		void resume();
+
+		// await() then resume()
+		void await_and_resume();
+
+	private:
+
+		// flags a thread can block on are set while holding m_lock so the notify cant be missed
+		std::atomic_bool m_shouldawait;
+		std::atomic_bool m_done;
+		std::atomic_bool m_shouldresume;
+		std::atomic_size_t m_joinedcount;
+		size_t m_spincount;
+		mutex m_lock;
+		condition_variable m_cond;
+
+		template<typename Pred>
+		void wait_until(Pred pred);
+
+		void _submit() override;
+		void _join() override;
+		void _mark_done() override;
+	};
 
 }
 
@@ -1,6 +1,8 @@
 
 namespace cjs {
 
+	inline ifence::~ifence() { }
+
 	inline fence::fence()
 		: m_shouldawait(false), m_done(false), m_shouldresume(false), m_joinedcount(0) { }
 
@@ -38,4 +40,64 @@ namespace cjs {
 	inline void fence::_mark_done() {
 		m_done = true;
 	}
+
+	inline slow_fence::slow_fence(size_t spincount)
+		: m_shouldawait(false), m_done(false), m_shouldresume(false), m_joinedcount(0), m_spincount(spincount) { }
+
+	inline slow_fence::~slow_fence() {
+		await_and_resume();
+	}
+
+	inline void slow_fence::await() {
+		wait_until([this]() { return !m_shouldawait || m_done; });
+		m_shouldawait = false;
+	}
+
+	inline void slow_fence::resume() {
+		{
+			mutex_guard mg(m_lock);
+			m_shouldresume = true;
+		}
+		m_cond.notify_all();
+		wait_until([this]() { return m_joinedcount == 0; });
+	}
+
+	inline void slow_fence::await_and_resume() {
+		await();
+		resume();
+	}
+
+	template<typename Pred>
+	inline void slow_fence::wait_until(Pred pred) {
+		for (size_t i = 0; i < m_spincount; i++) {
+			if (pred()) return;
+			std::this_thread::yield();
+		}
+		unique_lock lk(m_lock);
+		m_cond.wait(lk, pred);
+	}
+
+	inline void slow_fence::_submit() {
+		await_and_resume();
+		m_done = m_shouldresume = false;
+		m_shouldawait = true;
+	}
+
+	inline void slow_fence::_join() {
+		++m_joinedcount;
+		wait_until([this]() { return m_shouldresume.load(); });
+		{
+			mutex_guard mg(m_lock);
+			--m_joinedcount;
+		}
+		m_cond.notify_all();
+	}
+
+	inline void slow_fence::_mark_done() {
+		{
+			mutex_guard mg(m_lock);
+			m_done = true;
+		}
+		m_cond.notify_all();
+	}
 }
\ No newline at end of file
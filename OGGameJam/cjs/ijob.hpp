@@ -9,6 +9,27 @@ namespace cjs {
 		virtual void execute() = 0;
 	};
 
+	// told about every job a worker_thread runs, for profilers and the like
+	// job is null for function jobs
+	// a job can be destroyed as soon as it has run, so the job passed to job_end must never be dereferenced
+	// take anything needed from the job in job_begin
+	struct ijob_observer {
+		virtual void job_begin(ijob* job) = 0;
+		virtual void job_end(ijob* job) = 0;
+	};
+
+	namespace detail {
+		inline std::atomic<ijob_observer*>& job_observer() {
+			static std::atomic<ijob_observer*> observer = nullptr;
+			return observer;
+		}
+	}
+
+	// set to nullptr to stop observing, the observer has to outlive any job that is already running
+	inline void set_job_observer(ijob_observer* observer) {
+		detail::job_observer().store(observer, std::memory_order_release);
+	}
+
 }
 
 #endif // CJS_!IJOB_HPP
\ No newline at end of file
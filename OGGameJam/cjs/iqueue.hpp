@@ -1,6 +1,6 @@
 #ifndef CJS_IQUEUE_HPP
 #define CJS_IQUEUE_HPP
-#include "detail\work.hpp"
+#include "detail/work.hpp"
 
 namespace cjs {
 
@@ -11,9 +11,18 @@ namespace cjs {
 	class iqueue {
 		using work_t = cjs::detail::work;
 	public:
-		virtual work_t _get_work() = 0;
+
+		// lets jobs submit more jobs without knowing the queue type, see graph_job
+		virtual void submit(ijob* job_object) = 0;
+
+		virtual work_t _get_work(worker_thread* worker) = 0;
 		virtual void _add_worker(worker_thread* worker) = 0;
 		virtual void _remove_worker(worker_thread* worker) = 0;
+
+		// blocks an idle worker until there may be work or shouldstop is set
+		virtual void _park(worker_thread* worker, const std::atomic_bool& shouldstop) = 0;
+		// wakes every parked worker
+		virtual void _unpark_all() = 0;
 	};
 
 }
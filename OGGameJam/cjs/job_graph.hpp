@@ -0,0 +1,93 @@
+#ifndef CJS_JOB_GRAPH_HPP
+#define CJS_JOB_GRAPH_HPP
+#include "common.hpp"
+#include "ijob.hpp"
+#include "iqueue.hpp"
+
+namespace cjs {
+
+	// counts unfinished jobs so a thread can wait on just those jobs instead of stopping every worker with a fence
+	class job_group final {
+		CJS_NO_COPY(job_group);
+		CJS_NO_MOVE(job_group);
+	public:
+
+		job_group(size_t spincount = 1000);
+
+		// waits for the group
+		~job_group();
+
+		// adds count unfinished jobs, call before they are submitted
+		void add(size_t count = 1);
+
+		// marks one job as finished
+		void done();
+
+		// checks if every added job has finished
+		bool is_done() const;
+
+		// blocks until every added job has finished, spins for a short while first
+		void wait();
+
+	private:
+
+		std::atomic_size_t m_pending;
+		size_t m_spincount;
+		mutex m_lock;
+		condition_variable m_cond;
+	};
+
+	// a job that only runs once the jobs it depends on have finished
+	// the last dependency to finish submits it to the same queue
+	class graph_job : public ijob {
+	public:
+
+		graph_job();
+
+		// the work, run once every dependency has finished
+		virtual void run() = 0;
+
+		// makes this job run after *other*, call before either is submitted
+		void depends_on(graph_job& other);
+
+		// forgets all dependencies so the job can be used in a new graph
+		// only call once the job has finished
+		void reset();
+
+		// hands the job to queue, it runs right away if nothing it depends on is still unfinished
+		// group is told once it has finished
+		// every job in a graph has to be submitted before waiting on the group
+		void submit_to(iqueue& queue, job_group& group);
+
+		// like submit_to but runs the job on the calling thread before returning
+		// only for jobs that dont depend on anything, continuations still go to queue
+		void run_here(iqueue& queue, job_group& group);
+
+		// runs the job then finishes it
+		void execute() override;
+
+	protected:
+
+		// submits the continuations that are now ready and tells the group
+		// jobs that keep working after execute returns (like parallel_for_job) override execute and call this last
+		void finish();
+
+		// the queue the job was submitted to
+		iqueue& queue() const;
+
+	private:
+
+		// dependencies that havent finished, plus one until submit_to is called
+		std::atomic_size_t m_pending;
+		std::vector<graph_job*> m_continuations;
+		iqueue* m_queue;
+		job_group* m_group;
+
+		void release();
+	};
+
+}
+
+#include "job_graph.inl"
+
+#endif // !CJS_JOB_GRAPH_HPP
\ No newline at end of file
@@ -0,0 +1,95 @@
+
+namespace cjs {
+
+	inline job_group::job_group(size_t spincount)
+		: m_pending(0), m_spincount(spincount) { }
+
+	inline job_group::~job_group() {
+		wait();
+	}
+
+	inline void job_group::add(size_t count) {
+		m_pending.fetch_add(count, std::memory_order_relaxed);
+	}
+
+	inline void job_group::done() {
+		size_t pending = m_pending.load(std::memory_order_relaxed);
+		while (pending > 1) {
+			if (m_pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+				return;
+		}
+		// the last job only counts down while holding the lock, so a waiter that sees the group done
+		// still blocks on the lock in wait until this has notified and let go, and the group can be destroyed right after
+		mutex_guard mg(m_lock);
+		if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			m_cond.notify_all();
+	}
+
+	inline bool job_group::is_done() const {
+		return m_pending.load(std::memory_order_acquire) == 0;
+	}
+
+	inline void job_group::wait() {
+		for (size_t i = 0; i < m_spincount; i++) {
+			if (is_done()) break;
+			std::this_thread::yield();
+		}
+		// always taken, even after the spin saw the group done, whoever finished it may still hold the lock
+		unique_lock lk(m_lock);
+		m_cond.wait(lk, [this]() { return is_done(); });
+	}
+
+	inline graph_job::graph_job()
+		: m_pending(1), m_queue(nullptr), m_group(nullptr) { }
+
+	inline void graph_job::depends_on(graph_job& other) {
+		m_pending.fetch_add(1, std::memory_order_relaxed);
+		other.m_continuations.push_back(this);
+	}
+
+	inline void graph_job::reset() {
+		m_pending.store(1, std::memory_order_relaxed);
+		m_continuations.clear();
+		m_queue = nullptr;
+		m_group = nullptr;
+	}
+
+	inline void graph_job::submit_to(iqueue& queue, job_group& group) {
+		m_queue = &queue;
+		m_group = &group;
+		group.add();
+		release();
+	}
+
+	inline void graph_job::run_here(iqueue& queue, job_group& group) {
+		m_queue = &queue;
+		m_group = &group;
+		group.add();
+		m_pending.store(0, std::memory_order_relaxed);
+		execute();
+	}
+
+	inline void graph_job::execute() {
+		run();
+		finish();
+	}
+
+	inline void graph_job::finish() {
+		for (graph_job* next : m_continuations) {
+			next->release();
+		}
+		// last, the owner may reset this job as soon as the group is done
+		m_group->done();
+	}
+
+	inline iqueue& graph_job::queue() const {
+		return *m_queue;
+	}
+
+	inline void graph_job::release() {
+		if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			m_queue->submit(this);
+		}
+	}
+
+}
\ No newline at end of file
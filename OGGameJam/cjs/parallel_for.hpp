@@ -0,0 +1,111 @@
+#ifndef CJS_PARALLEL_FOR_HPP
+#define CJS_PARALLEL_FOR_HPP
+#include "common.hpp"
+#include "job_graph.hpp"
+
+namespace cjs {
+
+	namespace detail {
+
+		// hands out chunks of [begin, end) from a shared cursor to however many threads claim them
+		// chunks start large and shrink as the range runs out but stay a multiple of grain
+		class chunk_cursor {
+		public:
+
+			chunk_cursor();
+
+			// call before anyone claims, participants is how many threads are expected to claim
+			void set(size_t begin, size_t end, size_t grain, size_t participants);
+
+			// the number of chunks the range splits into at the smallest size
+			size_t max_chunks() const;
+
+			// false once the range has run out
+			bool claim(size_t& first, size_t& last);
+
+		private:
+
+			size_t m_begin;
+			size_t m_end;
+			size_t m_grain;
+			size_t m_participants;
+			std::atomic_size_t m_cursor;
+		};
+
+		// one parallel_for call, shared by the calling thread and the helpers it submitted
+		// helpers still queued when the call returns keep it alive, whoever lets go of it last deletes it
+		template<typename Func>
+		struct parallel_for_call {
+
+			struct helper final : ijob {
+				parallel_for_call* call = nullptr;
+				void execute() override;
+			};
+
+			parallel_for_call(size_t begin, size_t end, size_t grain, Func func, size_t helpers);
+
+			// claims and runs chunks until there are none left
+			void run();
+			void release();
+
+			chunk_cursor chunks;
+			Func func;
+			std::vector<helper> helpers;
+			job_group running; // helpers that started before the chunks ran out
+			std::atomic_size_t refs;
+		};
+
+	}
+
+	// calls func(first, last) over [begin, end) split into chunks that the workers claim from a shared cursor
+	// chunks start large and shrink as the range runs out but stay a multiple of grain, chunk starts are
+	// multiples of grain from begin. a worker that finishes early just claims more, nobody waits on a fixed split
+	// finishes once every chunk has run, which releases its continuations like any graph_job
+	template<typename Func>
+	class parallel_for_job final : public graph_job {
+	public:
+
+		// helpers is how many extra jobs are submitted to claim chunks next to the one that starts the loop
+		parallel_for_job(size_t helpers = 4);
+		// for one off loops, func doesnt need to be default constructible or assignable
+		parallel_for_job(size_t begin, size_t end, size_t grain, Func func, size_t helpers = 4);
+
+		// sets the loop, call before submitting and only once the last loop has finished
+		void set(size_t begin, size_t end, size_t grain, Func func);
+
+		// number of chunks run by the last loop
+		size_t chunk_count() const;
+
+		// claims and runs chunks until there are none left
+		void run() override;
+
+		// submits the helpers then works alongside them
+		void execute() override;
+
+	private:
+
+		struct helper final : ijob {
+			parallel_for_job* loop = nullptr;
+			void execute() override;
+		};
+
+		void leave();
+
+		std::vector<helper> m_helpers;
+		detail::chunk_cursor m_range;
+		Func m_func;
+		std::atomic_size_t m_active; // the starting job and the helpers that havent left yet
+		std::atomic_size_t m_chunks;
+	};
+
+	// runs func(first, last) over [begin, end) and waits for it, the calling thread claims chunks too
+	// once the chunks run out it only waits on the helpers that got to run one, helpers still queued
+	// behind other work are left to find nothing, so a busy queue never holds the caller up
+	template<typename Func>
+	void parallel_for(iqueue& queue, size_t begin, size_t end, size_t grain, Func func, size_t helpers = 4);
+
+}
+
+#include "parallel_for.inl"
+
+#endif // !CJS_PARALLEL_FOR_HPP
\ No newline at end of file
@@ -0,0 +1,150 @@
+
+namespace cjs {
+
+	namespace detail {
+
+		inline chunk_cursor::chunk_cursor()
+			: m_begin(0), m_end(0), m_grain(1), m_participants(1), m_cursor(0) { }
+
+		inline void chunk_cursor::set(size_t begin, size_t end, size_t grain, size_t participants) {
+			m_begin = begin;
+			m_end = end < begin ? begin : end;
+			m_grain = grain == 0 ? 1 : grain;
+			m_participants = participants == 0 ? 1 : participants;
+			m_cursor.store(m_begin, std::memory_order_relaxed);
+		}
+
+		inline size_t chunk_cursor::max_chunks() const {
+			return (m_end - m_begin + m_grain - 1) / m_grain;
+		}
+
+		inline bool chunk_cursor::claim(size_t& first, size_t& last) {
+			// acquire and release so a thread that sees the range run out also sees everything done before the last claim
+			size_t cursor = m_cursor.load(std::memory_order_acquire);
+			while (cursor < m_end) {
+				// guided, take a share of what is left so the last chunks are small enough to balance out
+				size_t size = (m_end - cursor) / (m_participants * 2);
+				size = size < m_grain ? m_grain : size - (size % m_grain);
+				const size_t next = (m_end - cursor) <= size ? m_end : cursor + size;
+				if (m_cursor.compare_exchange_weak(cursor, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					first = cursor;
+					last = next;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		template<typename Func>
+		inline parallel_for_call<Func>::parallel_for_call(size_t begin, size_t end, size_t grain, Func func, size_t helpers)
+			: func(std::move(func)), refs(0) {
+			chunks.set(begin, end, grain, helpers + 1);
+			// no point in helpers that couldnt get a chunk
+			const size_t count = chunks.max_chunks();
+			this->helpers.resize(count > 1 ? (count - 1 < helpers ? count - 1 : helpers) : 0);
+			for (auto& h : this->helpers) h.call = this;
+			refs.store(this->helpers.size() + 1, std::memory_order_relaxed);
+		}
+
+		template<typename Func>
+		inline void parallel_for_call<Func>::run() {
+			size_t first, last;
+			while (chunks.claim(first, last)) {
+				func(first, last);
+			}
+		}
+
+		template<typename Func>
+		inline void parallel_for_call<Func>::release() {
+			if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				delete this;
+			}
+		}
+
+		template<typename Func>
+		inline void parallel_for_call<Func>::helper::execute() {
+			// counted before claiming, a caller that finds the chunks gone then also sees this helper running
+			call->running.add();
+			call->run();
+			call->running.done();
+			// last, the call and this helper may be deleted here
+			call->release();
+		}
+
+	}
+
+	template<typename Func>
+	inline parallel_for_job<Func>::parallel_for_job(size_t helpers)
+		: m_helpers(helpers), m_func(), m_active(0), m_chunks(0) {
+		for (auto& h : m_helpers) h.loop = this;
+	}
+
+	template<typename Func>
+	inline parallel_for_job<Func>::parallel_for_job(size_t begin, size_t end, size_t grain, Func func, size_t helpers)
+		: m_helpers(helpers), m_func(std::move(func)), m_active(0), m_chunks(0) {
+		m_range.set(begin, end, grain, m_helpers.size() + 1);
+		for (auto& h : m_helpers) h.loop = this;
+	}
+
+	template<typename Func>
+	inline void parallel_for_job<Func>::set(size_t begin, size_t end, size_t grain, Func func) {
+		m_range.set(begin, end, grain, m_helpers.size() + 1);
+		m_func = std::move(func);
+		m_chunks.store(0, std::memory_order_relaxed);
+	}
+
+	template<typename Func>
+	inline size_t parallel_for_job<Func>::chunk_count() const {
+		return m_chunks.load(std::memory_order_relaxed);
+	}
+
+	template<typename Func>
+	inline void parallel_for_job<Func>::run() {
+		size_t first, last;
+		while (m_range.claim(first, last)) {
+			m_func(first, last);
+			m_chunks.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	template<typename Func>
+	inline void parallel_for_job<Func>::execute() {
+		// no point in helpers that couldnt get a chunk
+		const size_t chunks = m_range.max_chunks();
+		const size_t helpers = chunks > 1 ? (chunks - 1 < m_helpers.size() ? chunks - 1 : m_helpers.size()) : 0;
+		m_active.store(helpers + 1, std::memory_order_relaxed);
+		for (size_t i = 0; i < helpers; i++) {
+			queue().submit(&m_helpers[i]);
+		}
+		run();
+		leave();
+	}
+
+	template<typename Func>
+	inline void parallel_for_job<Func>::leave() {
+		// whoever leaves last finishes the loop, by then every chunk has run and no helper is still queued
+		if (m_active.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			finish();
+		}
+	}
+
+	template<typename Func>
+	inline void parallel_for_job<Func>::helper::execute() {
+		loop->run();
+		loop->leave();
+	}
+
+	template<typename Func>
+	inline void parallel_for(iqueue& queue, size_t begin, size_t end, size_t grain, Func func, size_t helpers) {
+		// the helpers can outlive this call, so they share a call on the heap instead of a job on the stack
+		auto* call = new detail::parallel_for_call<Func>(begin, end, grain, std::move(func), helpers);
+		for (auto& h : call->helpers) {
+			queue.submit(&h);
+		}
+		call->run();
+		// every chunk has been claimed, only the helpers still running one are waited on
+		call->running.wait();
+		call->release();
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef CJS_RING_QUEUE_HPP
+#define CJS_RING_QUEUE_HPP
+#include "common.hpp"
+#include "ijob.hpp"
+#include "fence.hpp"
+#include "detail/work.hpp"
+#include "iqueue.hpp"
+#include <memory>
+
+namespace cjs {
+
+	// bounded lock free multi producer multi consumer queue
+	// all slots are allocated up front, submitting and popping never allocate or take a lock
+	// (parking idle workers still uses a condition variable)
+	class ring_queue final : public iqueue {
+		CJS_NO_COPY(ring_queue);
+		CJS_NO_MOVE(ring_queue);
+	public:
+
+		// capacity is rounded up to a power of two
+		ring_queue(size_t capacity = 4096);
+
+		~ring_queue();
+
+		// returns the amount of work, approximate while other threads are using the queue
+		size_t size() const;
+
+		// returns the number of slots
+		size_t capacity() const;
+
+		// submitting jobs
+		// the try_ versions return false if the queue is full, the others yield until there is space
+
+		// submit a job to be worked on
+		bool try_submit(ijob* job_object);
+		void submit(ijob* job_object) override;
+
+		// submit a function to call
+		bool try_submit(void(*job_func)(void*), void* value = nullptr);
+		void submit(void(*job_func)(void*), void* value = nullptr);
+
+		// submits a fence to stop the threads
+		// will only block as many threads as there are at the time of submission
+		// takes one slot per worker, with no workers the fence is done right away
+		void submit(ifence* fence_object);
+
+	private:
+
+		using work_t = cjs::detail::work;
+		using mutex = std::mutex;
+		using mutex_guard = std::lock_guard<std::mutex>;
+
+		// a cell is free for the producer at position p when sequence == p
+		// and holds work for the consumer at position p when sequence == p + 1
+		struct alignas(64) cell {
+			std::atomic_size_t sequence;
+			work_t work;
+		};
+
+		bool try_push(const work_t& work, size_t count);
+		bool try_pop(work_t& work);
+		void wake_workers(bool all);
+
+		std::unique_ptr<cell[]> m_cells;
+		size_t m_mask;
+		alignas(64) std::atomic_size_t m_enqueue_pos;
+		alignas(64) std::atomic_size_t m_dequeue_pos;
+		alignas(64) std::atomic_size_t m_worker_count;
+
+		mutex m_idle_lock;
+		condition_variable m_idle_cv;
+		std::atomic_size_t m_sleepers;
+
+		work_t _get_work(worker_thread* worker) override;
+		void _add_worker(worker_thread* worker) override;
+		void _remove_worker(worker_thread* worker) override;
+		void _park(worker_thread* worker, const std::atomic_bool& shouldstop) override;
+		void _unpark_all() override;
+	};
+
+}
+
+#include "ring_queue.inl"
+
+#endif // !CJS_RING_QUEUE_HPP
\ No newline at end of file
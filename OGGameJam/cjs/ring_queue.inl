@@ -0,0 +1,158 @@
+
+namespace cjs {
+
+	inline ring_queue::ring_queue(size_t capacity)
+		: m_mask(0), m_enqueue_pos(0), m_dequeue_pos(0), m_worker_count(0), m_sleepers(0) {
+		size_t sz = 2;
+		while (sz < capacity) sz *= 2;
+		m_mask = sz - 1;
+		m_cells.reset(new cell[sz]);
+		for (size_t i = 0; i < sz; i++) {
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	inline ring_queue::~ring_queue() { }
+
+	inline size_t ring_queue::size() const {
+		const size_t enq = m_enqueue_pos.load(std::memory_order_relaxed);
+		const size_t deq = m_dequeue_pos.load(std::memory_order_relaxed);
+		return enq > deq ? enq - deq : 0;
+	}
+
+	inline size_t ring_queue::capacity() const {
+		return m_mask + 1;
+	}
+
+	inline bool ring_queue::try_submit(ijob* job_object) {
+		work_t work;
+		work.object = job_object;
+		work.type = work_t::type_object;
+		if (!try_push(work, 1)) return false;
+		wake_workers(false);
+		return true;
+	}
+
+	inline void ring_queue::submit(ijob* job_object) {
+		while (!try_submit(job_object)) std::this_thread::yield();
+	}
+
+	inline bool ring_queue::try_submit(void(*job_func)(void*), void* value) {
+		work_t work;
+		work.func = job_func;
+		work.func_val = value;
+		work.type = work_t::type_func;
+		if (!try_push(work, 1)) return false;
+		wake_workers(false);
+		return true;
+	}
+
+	inline void ring_queue::submit(void(*job_func)(void*), void* value) {
+		while (!try_submit(job_func, value)) std::this_thread::yield();
+	}
+
+	inline void ring_queue::submit(ifence* fence_object) {
+		const size_t workers = m_worker_count;
+		CJS_ASSERT(workers <= capacity(), "not enough slots for a fence");
+		work_t work;
+		work.fence = fence_object;
+		work.type = work_t::type_fence;
+		work.fence->_submit();
+		// no worker to stop, and no copy would ever be popped to mark it
+		if (workers == 0) {
+			work.fence->_mark_done();
+			return;
+		}
+		// one copy per worker in consecutive slots, so nothing can be submitted between them
+		while (!try_push(work, workers)) std::this_thread::yield();
+		wake_workers(true);
+	}
+
+	inline bool ring_queue::try_push(const work_t& work, size_t count) {
+		size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+		for (;;) {
+			// every cell in the range has to be free for this lap
+			bool free = true;
+			for (size_t i = 0; i < count && free; i++) {
+				const size_t seq = m_cells[(pos + i) & m_mask].sequence.load(std::memory_order_acquire);
+				const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + i);
+				if (diff < 0) return false; // full
+				free = diff == 0;
+			}
+
+			if (free && m_enqueue_pos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+				break;
+			if (!free) pos = m_enqueue_pos.load(std::memory_order_relaxed);
+		}
+
+		for (size_t i = 0; i < count; i++) {
+			cell& c = m_cells[(pos + i) & m_mask];
+			c.work = work;
+			// the last fence copy popped marks the fence as done
+			c.work.thread_count = count - 1 - i;
+			c.sequence.store(pos + i + 1, std::memory_order_release);
+		}
+		return true;
+	}
+
+	inline bool ring_queue::try_pop(work_t& work) {
+		size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+		cell* c;
+		for (;;) {
+			c = &m_cells[pos & m_mask];
+			const size_t seq = c->sequence.load(std::memory_order_acquire);
+			const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+			if (diff == 0) {
+				if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false; // empty
+			} else {
+				pos = m_dequeue_pos.load(std::memory_order_relaxed);
+			}
+		}
+
+		work = c->work;
+		c->sequence.store(pos + m_mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	inline void ring_queue::wake_workers(bool all) {
+		// pairs with the increment of m_sleepers in _park
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_sleepers.load() == 0) return;
+		{ mutex_guard mg(m_idle_lock); }
+		if (all) m_idle_cv.notify_all();
+		else m_idle_cv.notify_one();
+	}
+
+	inline ring_queue::work_t ring_queue::_get_work(worker_thread* worker) {
+		work_t work;
+		if (!try_pop(work)) return work_t();
+		// copies of a fence are claimed in order so every worker has reached it once the last is taken
+		if (work.type == work_t::type_fence && work.thread_count == 0)
+			work.fence->_mark_done();
+		return work;
+	}
+
+	inline void ring_queue::_add_worker(worker_thread* worker) {
+		++m_worker_count;
+	}
+
+	inline void ring_queue::_remove_worker(worker_thread* worker) {
+		--m_worker_count;
+	}
+
+	inline void ring_queue::_park(worker_thread* worker, const std::atomic_bool& shouldstop) {
+		unique_lock lk(m_idle_lock);
+		++m_sleepers;
+		m_idle_cv.wait(lk, [this, &shouldstop]() { return shouldstop || size() > 0; });
+		--m_sleepers;
+	}
+
+	inline void ring_queue::_unpark_all() {
+		{ mutex_guard mg(m_idle_lock); }
+		m_idle_cv.notify_all();
+	}
+
+}
\ No newline at end of file
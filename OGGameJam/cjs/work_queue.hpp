@@ -3,16 +3,25 @@
 #include "common.hpp"
 #include "ijob.hpp"
 #include "fence.hpp"
-#include "detail\work.hpp"
+#include "detail/work.hpp"
+#include "detail/work_deque.hpp"
 #include "iqueue.hpp"
+#include <array>
 
 namespace cjs {
 
+	// each attached worker owns a deque that it pushes and pops from, idle workers steal from the others
+	// work submitted from outside the workers (and all fences) goes through a shared list
+	// that the workers pull batches from
+	// workers that run out of work park until something is submitted
 	class work_queue final : public iqueue {
 		CJS_NO_COPY(work_queue);
 		CJS_NO_MOVE(work_queue);
 	public:
 
+		// the most workers that can be attached at once
+		static constexpr size_t max_workers = 32;
+
 		// constructs the work queue with the specified number of nodes in a pool
 		work_queue(size_t minpoolsize = 0);
 
@@ -28,20 +37,23 @@ namespace cjs {
 		size_t total_size();
 
 		// submitting jobs
+		// jobs and functions submitted from one of the workers go straight into that workers deque
 
 		// submit a job to be worked on
-		void submit(ijob* job_object);
+		void submit(ijob* job_object) override;
 
 		// submit a function to call
 		void submit(void(*job_func)(void*), void* value = nullptr);
 
 		// submits a fence to stop the threads
 		// will only block as many threads as there are at the time of submission
+		// with no workers the fence is done right away
 		void submit(ifence* fence_object);
 
 	private:
 
 		using work_t = cjs::detail::work;
+		using deque_t = cjs::detail::work_deque;
 		using mutex = std::mutex;
 		using mutex_guard = std::lock_guard<std::mutex>;
 		using atomic_bool = std::atomic_bool;
@@ -52,8 +64,10 @@ namespace cjs {
 			work_t work;
 		};
 
-		work_t pop_work();
+		work_t pop_work(deque_t* local = nullptr);
 		void push_work(work_t work);
+		void submit_work(work_t work);
+		void pop_front();
 		work_node* m_worklist_front;
 		work_node* m_worklist_back;
 		size_t m_worklist_sz;
@@ -66,10 +80,35 @@ namespace cjs {
 
 		mutex m_worker_lock;
 		std::vector<worker_thread*> m_workers;
+		std::atomic_size_t m_worker_count;
+
+		// deques are never freed while the queue is alive, a detached workers deque
+		// stays stealable until a new worker adopts it
+		std::array<std::atomic<deque_t*>, max_workers> m_deques;
+		std::atomic_size_t m_deque_count;
+		deque_t* find_deque(worker_thread* worker);
+		bool steal_work(deque_t* local, work_t& work);
+
+		// parked workers wait on m_idle_cv, m_sleepers is only changed while holding m_idle_lock
+		bool has_work();
+		void wake_workers(bool all);
+		mutex m_idle_lock;
+		condition_variable m_idle_cv;
+		std::atomic_size_t m_sleepers;
+
+		// the deque owned by the calling thread, zero initialized like any thread_local
+		struct local_deque {
+			work_queue* queue;
+			deque_t* deque;
+			size_t victim;
+		};
+		inline static thread_local local_deque t_local;
 
-		work_t _get_work() override;
+		work_t _get_work(worker_thread* worker) override;
 		void _add_worker(worker_thread* worker) override;
 		void _remove_worker(worker_thread* worker) override;
+		void _park(worker_thread* worker, const std::atomic_bool& shouldstop) override;
+		void _unpark_all() override;
 	};
 
 }
@@ -4,7 +4,11 @@ namespace cjs {
 
 	inline work_queue::work_queue(size_t minpoolsize)
 		: m_worklist_front(nullptr), m_worklist_back(nullptr), m_worklist_sz(0)
-		, m_nodepool(nullptr), m_nodepool_sz(minpoolsize) {
+		, m_nodepool(nullptr), m_nodepool_sz(minpoolsize)
+		, m_worker_count(0), m_deque_count(0), m_sleepers(0) {
+		for (auto& deque : m_deques) {
+			deque = nullptr;
+		}
 		for (size_t i = 0; i < minpoolsize; i++) {
 			work_node* node = new work_node();
 			node->next = m_nodepool;
@@ -18,6 +22,13 @@ namespace cjs {
 			pop_work();
 		}
 
+		// clean up deques
+		for (size_t i = 0; i < m_deque_count; i++) {
+			delete m_deques[i].load();
+			m_deques[i] = nullptr;
+		}
+		m_deque_count = 0;
+
 		// clean up pool
 		mutex_guard mg(m_nodepool_lock);
 		while (m_nodepool) {
@@ -29,8 +40,13 @@ namespace cjs {
 	}
 
 	inline size_t work_queue::size() {
+		size_t sz = 0;
+		const size_t dequecount = m_deque_count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < dequecount; i++) {
+			sz += m_deques[i].load(std::memory_order_relaxed)->size();
+		}
 		mutex_guard mg0(m_worklist_lock);
-		return m_worklist_sz;
+		return sz + m_worklist_sz;
 	}
 
 	inline size_t work_queue::pool_size() {
@@ -48,7 +64,7 @@ namespace cjs {
 		work_t work;
 		work.object = job_object;
 		work.type = work_t::type_object;
-		push_work(work);
+		submit_work(work);
 	}
 
 	inline void work_queue::submit(void(*job_func)(void*), void* value) {
@@ -56,48 +72,86 @@ namespace cjs {
 		work.func = job_func;
 		work.func_val = value;
 		work.type = work_t::type_func;
-		push_work(work);
+		submit_work(work);
 	}
 
 	inline void work_queue::submit(ifence* fence_object) {
 		work_t work;
 		work.fence = fence_object;
-		work.thread_count = m_workers.size() - 1;
+		work.thread_count = m_worker_count - 1;
 		work.type = work_t::type_fence;
 		work.fence->_submit();
+		// no worker to stop, and thread_count would wrap around so the fence never finished
+		if (m_worker_count == 0) {
+			work.fence->_mark_done();
+			return;
+		}
 		push_work(work);
+		// every worker has to reach the fence
+		wake_workers(true);
 	}
 
-	inline work_queue::work_t work_queue::pop_work() {
-		mutex_guard mg0(m_worklist_lock);
+	inline void work_queue::submit_work(work_t work) {
+		if (t_local.queue == this && t_local.deque && t_local.deque->push(work)) {
+			// pairs with the increment of m_sleepers in _park
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		} else {
+			push_work(work);
+		}
+		wake_workers(false);
+	}
+
+	inline work_queue::work_t work_queue::pop_work(deque_t* local) {
+		unique_lock lk(m_worklist_lock);
 		// empty list, return no work
 		if (m_worklist_sz == 0) return work_t();
 
 		// get front node
 		work_t work = m_worklist_front->work;
-		if (work.thread_count > 0)
+		if (work.thread_count > 0) {
 			m_worklist_front->work.thread_count--;
-		else {
-			work_node* node = m_worklist_front;
-			m_worklist_front = node->next;
-			--m_worklist_sz;
-			if (m_worklist_sz == 0)
-				m_worklist_back = m_worklist_front;
-
-			// push work_node into pool
-			mutex_guard mg1(m_nodepool_lock);
-			node->next = m_nodepool;
-			m_nodepool = node;
-			++m_nodepool_sz;
+			return work;
+		}
+		pop_front();
+		if (work.type == work_t::type_fence)
+			work.fence->_mark_done();
 
-			if (node->work.type == work_t::type_fence)
-				node->work.fence->_mark_done();
+		// move a share of what follows into the local deque so idle workers can steal it
+		// stops at fences so nothing submitted after one can run before it
+		if (local && work.type != work_t::type_fence) {
+			size_t batch = m_worklist_sz / (m_worker_count > 0 ? m_worker_count.load() : 1);
+			size_t moved = 0;
+			while (moved < batch && m_worklist_sz > 0 && m_worklist_front->work.type != work_t::type_fence) {
+				if (!local->push(m_worklist_front->work)) break;
+				pop_front();
+				++moved;
+			}
+			// someone should come and steal it
+			if (moved > 0) {
+				lk.unlock();
+				wake_workers(false);
+			}
 		}
 
 		// return the work
 		return work;
 	}
 
+	inline void work_queue::pop_front() {
+		// m_worklist_lock must be held
+		work_node* node = m_worklist_front;
+		m_worklist_front = node->next;
+		--m_worklist_sz;
+		if (m_worklist_sz == 0)
+			m_worklist_back = m_worklist_front;
+
+		// push work_node into pool
+		mutex_guard mg1(m_nodepool_lock);
+		node->next = m_nodepool;
+		m_nodepool = node;
+		++m_nodepool_sz;
+	}
+
 	inline void work_queue::push_work(work_t work) {
 		// get a node from the pool
 		work_node* node = get_or_make_node();
@@ -114,25 +168,115 @@ namespace cjs {
 	}
 
 	inline work_queue::work_node* work_queue::get_or_make_node() {
-		if (m_nodepool) {
+		{
 			// get a node from the pool
 			mutex_guard mg(m_nodepool_lock);
-			work_node* node = m_nodepool;
-			m_nodepool = node->next;
-			--m_nodepool_sz;
-			return node;
+			if (work_node* node = m_nodepool) {
+				m_nodepool = node->next;
+				--m_nodepool_sz;
+				return node;
+			}
 		}
 		// make a new node as needed
 		return new work_node();
 	}
 
-	inline work_queue::work_t work_queue::_get_work() {
-		return pop_work();
+	inline work_queue::deque_t* work_queue::find_deque(worker_thread* worker) {
+		mutex_guard mg(m_worker_lock);
+		const size_t dequecount = m_deque_count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < dequecount; i++) {
+			deque_t* deque = m_deques[i].load(std::memory_order_relaxed);
+			if (deque->owner == worker) return deque;
+		}
+		return nullptr;
+	}
+
+	inline bool work_queue::steal_work(deque_t* local, work_t& work) {
+		const size_t dequecount = m_deque_count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < dequecount; i++) {
+			// start from a different victim each time so thieves spread out
+			deque_t* victim = m_deques[(t_local.victim + i) % dequecount].load(std::memory_order_relaxed);
+			if (victim == local) continue;
+
+			deque_t::steal_result result;
+			do {
+				result = victim->steal(work);
+			} while (result == deque_t::steal_abort);
+
+			if (result == deque_t::steal_success) {
+				t_local.victim = (t_local.victim + i) % dequecount;
+				return true;
+			}
+		}
+		t_local.victim++;
+		return false;
+	}
+
+	inline work_queue::work_t work_queue::_get_work(worker_thread* worker) {
+		if (t_local.queue != this) {
+			t_local.queue = this;
+			t_local.deque = find_deque(worker);
+		}
+
+		work_t work;
+		deque_t* local = t_local.deque;
+
+		// newest local work first, then the oldest work of the others, then the shared list
+		if (local && local->pop(work)) return work;
+		if (steal_work(local, work)) return work;
+		return pop_work(local);
+	}
+
+	inline bool work_queue::has_work() {
+		const size_t dequecount = m_deque_count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < dequecount; i++) {
+			if (m_deques[i].load(std::memory_order_relaxed)->size() > 0) return true;
+		}
+		mutex_guard mg(m_worklist_lock);
+		return m_worklist_sz > 0;
+	}
+
+	inline void work_queue::wake_workers(bool all) {
+		if (m_sleepers.load() == 0) return;
+		// taking the lock makes sure a worker that just saw no work is already waiting
+		{ mutex_guard mg(m_idle_lock); }
+		if (all) m_idle_cv.notify_all();
+		else m_idle_cv.notify_one();
+	}
+
+	inline void work_queue::_park(worker_thread* worker, const std::atomic_bool& shouldstop) {
+		unique_lock lk(m_idle_lock);
+		++m_sleepers;
+		m_idle_cv.wait(lk, [this, &shouldstop]() { return shouldstop || has_work(); });
+		--m_sleepers;
+	}
+
+	inline void work_queue::_unpark_all() {
+		{ mutex_guard mg(m_idle_lock); }
+		m_idle_cv.notify_all();
 	}
 
 	inline void work_queue::_add_worker(worker_thread* worker) {
 		mutex_guard mg(m_worker_lock);
 		m_workers.push_back(worker);
+		m_worker_count = m_workers.size();
+
+		// adopt an unowned deque
+		const size_t dequecount = m_deque_count.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < dequecount; i++) {
+			deque_t* deque = m_deques[i].load(std::memory_order_relaxed);
+			if (deque->owner == nullptr) {
+				deque->owner = worker;
+				return;
+			}
+		}
+
+		// or make a new one
+		CJS_ASSERT(dequecount < max_workers, "too many workers attached to one work_queue");
+		deque_t* deque = new deque_t();
+		deque->owner = worker;
+		m_deques[dequecount].store(deque, std::memory_order_relaxed);
+		m_deque_count.store(dequecount + 1, std::memory_order_release);
 	}
 
 	inline void work_queue::_remove_worker(worker_thread* worker) {
@@ -140,6 +284,17 @@ namespace cjs {
 		for (auto it = m_workers.begin(); it != m_workers.end(); ++it) {
 			if (*it == worker) {
 				m_workers.erase(it);
+				break;
+			}
+		}
+		m_worker_count = m_workers.size();
+
+		// leave the deque behind, whatever is left in it can still be stolen
+		const size_t dequecount = m_deque_count.load(std::memory_order_relaxed);
+		for (size_t i = 0; i < dequecount; i++) {
+			deque_t* deque = m_deques[i].load(std::memory_order_relaxed);
+			if (deque->owner == worker) {
+				deque->owner = nullptr;
 				return;
 			}
 		}
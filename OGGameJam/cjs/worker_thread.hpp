@@ -20,14 +20,24 @@ namespace cjs {
 		// will start and stop the worker thread as needed
 		void attach_to(iqueue* queue);
 
+		// when enabled (the default) the worker parks once it has spun for a while without finding work
+		// when disabled it keeps polling the queue, lower wake up latency but burns a core while idle
+		void set_parking(bool enabled);
+
 	private:
 
 		using work_t = detail::work;
 
 		static void worker(worker_thread* thread);
 
+		// bounds for the number of empty polls before parking
+		// grows when work shows up while spinning and shrinks when the worker ends up parking anyway
+		static constexpr size_t min_spins = 16;
+		static constexpr size_t max_spins = 4096;
+
 		iqueue* m_queue;
 		atomic_bool m_shouldstop;
+		atomic_bool m_canpark;
 		thread m_thread;
 
 	};
@@ -1,11 +1,12 @@
 
 
 inline cjs::worker_thread::worker_thread()
-	: m_queue(nullptr), m_shouldstop(true) { }
+	: m_queue(nullptr), m_shouldstop(true), m_canpark(true) { }
 
 inline cjs::worker_thread::~worker_thread() {
 	if (m_queue) {
 		m_shouldstop = true;
+		m_queue->_unpark_all();
 		m_thread.join();
 		m_queue->_remove_worker(this);
 	}
@@ -16,6 +17,7 @@ inline void cjs::worker_thread::attach_to(iqueue* queue) {
 
 	if (m_queue) {
 		m_shouldstop = true;
+		m_queue->_unpark_all();
 		m_thread.join();
 		m_queue->_remove_worker(this);
 		m_queue = nullptr;
@@ -29,10 +31,38 @@ inline void cjs::worker_thread::attach_to(iqueue* queue) {
 	}
 }
 
+inline void cjs::worker_thread::set_parking(bool enabled) {
+	m_canpark = enabled;
+}
+
 inline void cjs::worker_thread::worker(worker_thread* thread) {
+	size_t spinlimit = min_spins;
+	size_t spins = 0;
 	while (!thread->m_shouldstop) {
 		if (auto* q = thread->m_queue) {
-			work_t work = q->_get_work();
+			work_t work = q->_get_work(thread);
+
+			if (work.type == work_t::type_none) {
+				if (!thread->m_canpark) continue;
+				if (++spins < spinlimit) {
+					std::this_thread::yield();
+					continue;
+				}
+				spinlimit = spinlimit / 2 < min_spins ? min_spins : spinlimit / 2;
+				spins = 0;
+				q->_park(thread, thread->m_shouldstop);
+				continue;
+			}
+			if (spins > 0) {
+				spinlimit = spinlimit * 2 > max_spins ? max_spins : spinlimit * 2;
+				spins = 0;
+			}
+
+			ijob_observer* observer = nullptr;
+			if (work.type != work_t::type_fence) {
+				observer = detail::job_observer().load(std::memory_order_acquire);
+				if (observer) observer->job_begin(work.type == work_t::type_object ? work.object : nullptr);
+			}
 
 			switch (work.type) {
 				case work_t::type_func:
@@ -46,6 +76,8 @@ inline void cjs::worker_thread::worker(worker_thread* thread) {
 					break;
 				default: break;
 			}
+
+			if (observer) observer->job_end(work.type == work_t::type_object ? work.object : nullptr);
 		}
 	}
 }